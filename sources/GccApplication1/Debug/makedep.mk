@@ -4,7 +4,11 @@
 
 buttons.c
 
-i2cmaster.c
+config_store.c
+
+diagnostics.c
+
+i2c_queue.c
 
 lcd.c
 
@@ -12,9 +16,23 @@ led.c
 
 main.c
 
+pitch_table.c
+
+powerfail.c
+
+rational.c
+
 revolutions.c
 
+scheduler.c
+
 setup_menu.c
 
+spindle.c
+
 support.c
 
+telemetry.c
+
+threading.c
+
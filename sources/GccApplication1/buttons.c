@@ -1,6 +1,30 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "buttons.h"
 
+#define BUTTONS_COUNT 5u
+#define BUTTONS_DEBOUNCE_TICKS 5u // 10 ms
+#define BUTTONS_LONG_PRESS_TICKS 250u // 500 ms, then the auto-repeat starts
+#define BUTTONS_REPEAT_FIRST_TICKS 50u // 100 ms
+#define BUTTONS_REPEAT_MIN_TICKS 8u // 16 ms, reached after about 15 repeats
+#define BUTTONS_EVENT_QUEUE_SIZE 8u // power of two
+
+typedef struct {
+	uint8_t bounce; // samples that differ from the debounced state
+	uint8_t held; // ticks since the press, up to BUTTONS_LONG_PRESS_TICKS
+	uint8_t repeat_countdown;
+	uint8_t repeat_interval;
+} button_t;
+
+static button_t buttons[BUTTONS_COUNT];
+static volatile uint8_t buttons_debounced = 0u; // bit per button, 1 = pressed
+
+/* Filled by the tick interrupt, read by the main program; each side writes only its own index. */
+static uint8_t button_events[BUTTONS_EVENT_QUEUE_SIZE];
+static volatile uint8_t button_events_head = 0u;
+static volatile uint8_t button_events_tail = 0u;
+
 void init_buttons() {
 	DDRD &= ~(1 << DDD4);
 	DDRD &= ~(1 << DDD6);
@@ -9,42 +33,137 @@ void init_buttons() {
 	DDRB &= ~(1 << DDB1);
 }
 
+/* raw pin levels, bit per button */
+static uint8_t buttons_read() {
+	uint8_t ret = 0;
+	if (!(PIND & (1 << PIND4))) {
+		ret |= 1 << BUTTON_1;
+	}
+	if (!(PIND & (1 << PIND6))) {
+		ret |= 1 << BUTTON_2;
+	}
+	if (!(PIND & (1 << PIND7))) {
+		ret |= 1 << BUTTON_3;
+	}
+	if (!(PINB & (1 << PINB0))) {
+		ret |= 1 << BUTTON_4;
+	}
+	if (!(PINB & (1 << PINB1))) {
+		ret |= 1 << BUTTON_5;
+	}
+	return ret;
+}
+
+/* a full queue drops the event */
+static void button_push_event(uint8_t event) {
+	uint8_t head = button_events_head;
+	uint8_t next = (head + 1u) & (BUTTONS_EVENT_QUEUE_SIZE - 1u);
+
+	if (next == button_events_tail) {
+		return;
+	}
+	button_events[head] = event;
+	button_events_head = next;
+}
+
+static void button_hold(uint8_t index, button_t *button) {
+	if (button->held < BUTTONS_LONG_PRESS_TICKS) {
+		if (++button->held == BUTTONS_LONG_PRESS_TICKS) {
+			button_push_event(BUTTON_EVENT(index, BUTTON_LONG_PRESS));
+			button->repeat_interval = BUTTONS_REPEAT_FIRST_TICKS;
+			button->repeat_countdown = BUTTONS_REPEAT_FIRST_TICKS;
+		}
+		return;
+	}
+	if (--button->repeat_countdown == 0u) {
+		button_push_event(BUTTON_EVENT(index, BUTTON_REPEAT));
+		button->repeat_interval -= button->repeat_interval / 8u; // speeds up the longer it is held
+		if (button->repeat_interval < BUTTONS_REPEAT_MIN_TICKS) {
+			button->repeat_interval = BUTTONS_REPEAT_MIN_TICKS;
+		}
+		button->repeat_countdown = button->repeat_interval;
+	}
+}
+
+/* called from the tick interrupt every 2 ms */
+void buttons_scan() {
+	uint8_t raw = buttons_read();
+	uint8_t debounced = buttons_debounced;
+
+	for (uint8_t i = 0; i < BUTTONS_COUNT; i++) {
+		uint8_t mask = 1u << i;
+		button_t *button = &buttons[i];
+
+		if ((raw ^ debounced) & mask) {
+			if (++button->bounce >= BUTTONS_DEBOUNCE_TICKS) {
+				button->bounce = 0u;
+				debounced ^= mask;
+				button->held = 0u;
+				button_push_event(BUTTON_EVENT(i, (debounced & mask) ? BUTTON_PRESSED : BUTTON_RELEASED));
+			}
+		} else {
+			button->bounce = 0u;
+		}
+		if (debounced & mask) {
+			button_hold(i, button);
+		}
+	}
+	buttons_debounced = debounced;
+}
+
 uint8_t button_1_is_pressed() {
-	return !(PIND & (1 << PIND4));
+	return (buttons_debounced >> BUTTON_1) & 1u;
 }
 
 uint8_t button_2_is_pressed() {
-	return !(PIND & (1 << PIND6));
+	return (buttons_debounced >> BUTTON_2) & 1u;
 }
 
 uint8_t button_3_is_pressed() {
-	return !(PIND & (1 << PIND7));
+	return (buttons_debounced >> BUTTON_3) & 1u;
 }
 
 uint8_t button_4_is_pressed() {
-	return !(PINB & (1 << PINB0));
+	return (buttons_debounced >> BUTTON_4) & 1u;
 }
 
 uint8_t button_5_is_pressed() {
-	return !(PINB & (1 << PINB1));
+	return (buttons_debounced >> BUTTON_5) & 1u;
 }
 
 uint8_t button_status() {
-	uint8_t ret = 0;
-	if (button_1_is_pressed()) {
-		ret |= 1;
-	}
-	if (button_2_is_pressed()) {
-		ret |= 1 << 1;
-	}
-	if (button_3_is_pressed()) {
-		ret |= 1 << 2;
-	}
-	if (button_4_is_pressed()) {
-		ret |= 1 << 3;
+	return buttons_debounced;
+}
+
+/* returns BUTTON_EVENT_NONE when the queue is empty */
+uint8_t button_get_event() {
+	uint8_t tail = button_events_tail;
+
+	if (tail == button_events_head) {
+		return BUTTON_EVENT_NONE;
 	}
-	if (button_5_is_pressed()) {
-		ret |= 1 << 4;
+	uint8_t event = button_events[tail];
+	button_events_tail = (tail + 1u) & (BUTTONS_EVENT_QUEUE_SIZE - 1u);
+	return event;
+}
+
+/* sleeps in idle mode until the next event */
+uint8_t button_wait_event() {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while (1) {
+		cli();
+		if (button_events_tail != button_events_head) {
+			sei();
+			return button_get_event();
+		}
+		sleep_enable();
+		sei(); // the instruction after sei is executed before any interrupt, the tick cannot be missed
+		sleep_cpu();
+		sleep_disable();
 	}
-	return ret;
+}
+
+/* forgets the events of the buttons pressed before a new dialog */
+void button_clear_events() {
+	button_events_tail = button_events_head;
 }
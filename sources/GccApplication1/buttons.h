@@ -3,7 +3,30 @@
 
 #include <stdint.h>
 
+/*
+ * The tick interrupt calls buttons_scan() every 2 ms. A button changes its state after 10 ms
+ * of stable samples, the levels below are the debounced ones. Every change goes into an event
+ * queue for the menus; a held button sends a long press after 500 ms and then repeats ever
+ * faster, from 100 ms down to 16 ms.
+ */
+#define BUTTON_1 0u // bit in button_status()
+#define BUTTON_2 1u
+#define BUTTON_3 2u
+#define BUTTON_4 3u
+#define BUTTON_5 4u
+
+#define BUTTON_PRESSED 0u
+#define BUTTON_RELEASED 1u
+#define BUTTON_LONG_PRESS 2u
+#define BUTTON_REPEAT 3u
+
+#define BUTTON_EVENT(button, type) (((type) << 4) | (button))
+#define BUTTON_EVENT_BUTTON(event) ((event) & 0x0Fu)
+#define BUTTON_EVENT_TYPE(event) ((event) >> 4)
+#define BUTTON_EVENT_NONE 0xFFu
+
 void init_buttons();
+void buttons_scan();
 uint8_t button_1_is_pressed();
 uint8_t button_2_is_pressed();
 uint8_t button_3_is_pressed();
@@ -11,4 +34,8 @@ uint8_t button_4_is_pressed();
 uint8_t button_5_is_pressed();
 uint8_t button_status();
 
-#endif /* BUTTONS_H_ */
\ No newline at end of file
+uint8_t button_get_event();
+uint8_t button_wait_event();
+void button_clear_events();
+
+#endif /* BUTTONS_H_ */
@@ -0,0 +1,68 @@
+#include "config_store.h"
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#define CONFIG_STORE_SLOTS 32u // 512 B of the 1 kB EEPROM, 100 000 writes per cell -> 3.2 million saves
+
+typedef struct {
+	uint16_t sequence; // of the save, the newest slot has the highest one
+	uint8_t version;
+	uint8_t data[CONFIG_STORE_MAX_LENGTH];
+	uint8_t crc; // of all bytes above
+} config_slot_t;
+
+static config_slot_t config_store_slots[CONFIG_STORE_SLOTS] EEMEM;
+static uint8_t config_store_last_slot = CONFIG_STORE_SLOTS - 1u;
+static uint16_t config_store_last_sequence = 0u;
+
+static uint8_t config_store_crc(const config_slot_t *slot) {
+	const uint8_t *bytes = (const uint8_t *)slot;
+	uint8_t crc = 0u;
+	for (uint8_t i = 0; i < offsetof(config_slot_t, crc); i++) {
+		crc = _crc8_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+uint8_t config_store_load(void *data, uint8_t length, uint8_t version) {
+	config_slot_t slot;
+	uint8_t found = 0u;
+
+	for (uint8_t i = 0; i < CONFIG_STORE_SLOTS; i++) {
+		eeprom_read_block(&slot, &config_store_slots[i], sizeof(slot));
+		if (slot.crc != config_store_crc(&slot)) {
+			continue; // erased or torn by a power loss during the save
+		}
+		if (found && ((int16_t)(slot.sequence - config_store_last_sequence) <= 0)) {
+			continue; // older
+		}
+		found = 1u;
+		config_store_last_slot = i;
+		config_store_last_sequence = slot.sequence;
+	}
+	if (!found) {
+		return 0;
+	}
+
+	eeprom_read_block(&slot, &config_store_slots[config_store_last_slot], sizeof(slot));
+	if (slot.version != version) {
+		return 0; // another layout, the next save continues after this slot
+	}
+	memcpy(data, slot.data, (length < CONFIG_STORE_MAX_LENGTH) ? length : CONFIG_STORE_MAX_LENGTH);
+	return 1;
+}
+
+void config_store_save(const void *data, uint8_t length, uint8_t version) {
+	config_slot_t slot;
+
+	memset(&slot, 0, sizeof(slot));
+	slot.sequence = ++config_store_last_sequence;
+	slot.version = version;
+	memcpy(slot.data, data, (length < CONFIG_STORE_MAX_LENGTH) ? length : CONFIG_STORE_MAX_LENGTH);
+	slot.crc = config_store_crc(&slot);
+
+	config_store_last_slot = (config_store_last_slot + 1u) % CONFIG_STORE_SLOTS;
+	eeprom_update_block(&slot, &config_store_slots[config_store_last_slot], sizeof(slot));
+}
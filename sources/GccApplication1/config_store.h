@@ -0,0 +1,20 @@
+#ifndef CONFIG_STORE_H_
+#define CONFIG_STORE_H_
+
+#include <stdint.h>
+
+/*
+ * Settings kept in the EEPROM. Every save goes to the next slot of a ring, so the cells wear
+ * evenly; each slot carries a sequence number, the layout version and a CRC, and the load takes
+ * the newest slot that is intact and has the expected version.
+ */
+
+#define CONFIG_STORE_MAX_LENGTH 12u
+
+/* returns 0 when there is no valid configuration of this version, data is left untouched then */
+uint8_t config_store_load(void *data, uint8_t length, uint8_t version);
+
+/* blocks for about 3.4 ms per changed byte */
+void config_store_save(const void *data, uint8_t length, uint8_t version);
+
+#endif /* CONFIG_STORE_H_ */
@@ -0,0 +1,80 @@
+#include "diagnostics.h"
+
+#if DIAGNOSTICS
+#include <util/atomic.h>
+#include "buttons.h"
+#include "lcd.h"
+#include "support.h"
+#include "spindle.h"
+
+volatile uint16_t diagnostics_encoder_isr_max = 0u;
+volatile uint16_t diagnostics_step_isr_max = 0u;
+volatile uint16_t diagnostics_following_error_max = 0u;
+uint16_t diagnostics_main_loops = 0u; // the main loop only
+
+static volatile uint16_t diagnostics_loops_per_second = 0u;
+static uint16_t diagnostics_loops_at_second = 0u; // the tick interrupt only
+static uint8_t diagnostics_shown = 0u;
+static uint8_t diagnostics_buttons = 0u; // to detect the push
+
+/* called from the tick interrupt once per second */
+void diagnostics_second() {
+	uint16_t loops = diagnostics_main_loops; // a torn read costs one wrong second
+	diagnostics_loops_per_second = loops - diagnostics_loops_at_second;
+	diagnostics_loops_at_second = loops;
+}
+
+/* called from the main loop */
+void diagnostics_update() {
+	uint8_t buttons = button_status();
+	uint8_t pushed = buttons & ~diagnostics_buttons;
+	diagnostics_buttons = buttons;
+
+	if (pushed & (1 << BUTTON_5)) {
+		diagnostics_shown = !diagnostics_shown;
+	}
+	if (diagnostics_shown && (pushed & (1 << BUTTON_4))) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			diagnostics_encoder_isr_max = 0u;
+			diagnostics_step_isr_max = 0u;
+			diagnostics_following_error_max = 0u;
+		}
+	}
+}
+
+uint8_t diagnostics_is_shown() {
+	return diagnostics_shown;
+}
+
+void diagnostics_display() {
+	uint16_t encoder_isr_max;
+	uint16_t step_isr_max;
+	uint16_t following_error_max;
+	uint16_t loops_per_second;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		encoder_isr_max = diagnostics_encoder_isr_max;
+		step_isr_max = diagnostics_step_isr_max;
+		following_error_max = diagnostics_following_error_max;
+		loops_per_second = diagnostics_loops_per_second;
+	}
+
+	lcd_set_cursor(0, 0);
+	lcd_puts("ztraceno hran ");
+	lcd_put_unsigned(get_encoder_errors(), 6, ' ');
+	lcd_set_cursor(0, 1);
+	lcd_puts("preteceni fr. ");
+	lcd_put_unsigned(get_step_queue_overruns(), 6, ' ');
+	lcd_set_cursor(0, 2);
+	lcd_puts("isr us ");
+	lcd_put_unsigned(encoder_isr_max / (HAL_STEP_TIMER_HZ / 1000000ul), 5, ' '); // constant divisor, a shift
+	lcd_puts(" krok");
+	lcd_put_unsigned(step_isr_max / (HAL_STEP_TIMER_HZ / 1000000ul), 3, ' ');
+	lcd_set_cursor(0, 3);
+	lcd_puts("odch");
+	lcd_put_unsigned(following_error_max, 5, ' ');
+	lcd_puts(" sm/s");
+	lcd_put_unsigned(loops_per_second, 6, ' ');
+	lcd_flush();
+}
+#endif
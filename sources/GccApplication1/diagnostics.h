@@ -0,0 +1,68 @@
+#ifndef DIAGNOSTICS_H_
+#define DIAGNOSTICS_H_
+
+#include <stdint.h>
+#include "main.h"
+#include "hal.h"
+
+/*
+ * Hot-path counters for finding the speed limits of a machine: execution time of the encoder and
+ * step interrupts (Timer1 ticks between the first and the last statement, without the prologue),
+ * the largest following error since the reset and the main-loop rate. Button 5 switches the main
+ * screen to the diagnostics page, button 4 on that page clears the maxima.
+ * DIAGNOSTICS 0 in main.h compiles all of it out.
+ */
+
+#if DIAGNOSTICS
+extern volatile uint16_t diagnostics_encoder_isr_max;
+extern volatile uint16_t diagnostics_step_isr_max;
+extern volatile uint16_t diagnostics_following_error_max;
+extern uint16_t diagnostics_main_loops;
+
+/* call from an interrupt only */
+static inline uint16_t diagnostics_time_begin() {
+	return hal_step_timer_now();
+}
+
+static inline void diagnostics_time_end(volatile uint16_t *max, uint16_t begin) {
+	uint16_t time = hal_step_timer_now() - begin;
+	if (time > *max) {
+		*max = time;
+	}
+}
+
+static inline void diagnostics_encoder_isr_end(uint16_t begin) {
+	diagnostics_time_end(&diagnostics_encoder_isr_max, begin);
+}
+
+static inline void diagnostics_step_isr_end(uint16_t begin) {
+	diagnostics_time_end(&diagnostics_step_isr_max, begin);
+}
+
+static inline void diagnostics_following_error(uint16_t error) {
+	if (error > diagnostics_following_error_max) {
+		diagnostics_following_error_max = error;
+	}
+}
+
+static inline void diagnostics_main_loop() {
+	diagnostics_main_loops++;
+}
+
+void diagnostics_second();
+void diagnostics_update();
+uint8_t diagnostics_is_shown();
+void diagnostics_display();
+#else
+static inline uint16_t diagnostics_time_begin() { return 0; }
+static inline void diagnostics_encoder_isr_end(uint16_t begin) { (void)begin; }
+static inline void diagnostics_step_isr_end(uint16_t begin) { (void)begin; }
+static inline void diagnostics_following_error(uint16_t error) { (void)error; }
+static inline void diagnostics_main_loop() {}
+static inline void diagnostics_second() {}
+static inline void diagnostics_update() {}
+static inline uint8_t diagnostics_is_shown() { return 0; }
+static inline void diagnostics_display() {}
+#endif
+
+#endif /* DIAGNOSTICS_H_ */
@@ -0,0 +1,25 @@
+/*
+ * Hardware abstraction of the registers used by the spindle/support logic.
+ * main.c, spindle.c, support.c and revolutions.c reach the pins, timers, interrupt vectors and
+ * interrupt masks only through hal.h, so the same sources build for the ATmega328P (hal_avr.h)
+ * and with HAL_HOST defined for the simulator on a PC (tools/host/hal_host.h).
+ * HAL_ISR(vector) defines an interrupt handler, HAL_ATOMIC_BLOCK() { } runs its block with the
+ * interrupts disabled.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+#define HAL_STEP_TIMER_HZ 2000000ul // Timer1, 16 MHz / 8
+#define HAL_STEP_TIMER_MIN_TICKS 8u // 4 us, a compare value closer to TCNT1 could be passed before it is written
+#define HAL_PULSE_WIDTH_TICKS 20u // 10 us
+
+#ifdef HAL_HOST
+#include "hal_host.h"
+#else
+#include "hal_avr.h"
+#endif
+
+#endif /* HAL_H_ */
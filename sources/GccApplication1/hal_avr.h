@@ -0,0 +1,292 @@
+/*
+ * ATmega328P implementation of hal.h, included only from there.
+ */
+
+#ifndef HAL_AVR_H_
+#define HAL_AVR_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+
+#define HAL_ISR(vector) ISR(vector)
+#define HAL_ATOMIC_BLOCK() ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+
+static inline void hal_irq_enable() {
+	sei();
+}
+
+/******* spindle encoder ******/
+/* yellow wire on PD2 (INT0), green wire on PB2 (PCINT2), both interrupt on every edge */
+static inline void hal_encoder_init() {
+	DDRD &= ~(1 << DDD2); // yellow wire as input
+	DDRB &= ~(1 << DDB2); // green wire as input
+	EICRA = (EICRA & ~((1 << ISC01) | (1 << ISC00))) | (1 << ISC00); // INT0 on any logical change - page 58
+	EIMSK |= (1 << INT0); // Enable INT0
+	PCMSK0 |= 1 << PCINT2; // only PB2, the buttons on PB0 and PB1 stay polled
+	PCICR |= 1 << PCIE0;
+}
+
+/* yellow << 1 | green */
+static inline uint8_t hal_encoder_state() {
+	return ((PIND >> (PIND2 - 1)) & 0x02) | ((PINB >> PINB2) & 0x01);
+}
+
+/******* pull-ups ******/
+/* every pin starts as an input with its pull-up, the modules then take their pins */
+static inline void hal_pull_ups_init() {
+	PORTB = 0xFF;
+	PORTC = 0xFF;
+	PORTD = 0xFF;
+}
+
+/******* stepper-motor driver ******/
+/* PC2 = Enable, PD3 = Pulse (OC2B), PC0 = Direction */
+static inline void hal_driver_init() {
+	DDRC |= 1 << DDC2; // Driver Enable
+	DDRD |= 1 << DDD3; // Driver Pulse
+	DDRC |= 1 << DDC0; // Driver Direction
+}
+
+static inline void hal_driver_enable() {
+	PORTC |= 1 << PORTC2; // Driver Enable -> 1 = enabled
+}
+
+static inline void hal_driver_disable() {
+	PORTC &= ~(1 << PORTC2);
+}
+
+static inline void hal_driver_direction_left() {
+	PORTC |= 1 << PORTC0;
+}
+
+static inline void hal_driver_direction_right() {
+	PORTC &= ~(1 << PORTC0);
+}
+
+/******* Timer 2 - one shot pulse for the driver ******/
+/* we are using this timer as a one shot timer https://hackaday.com/2015/03/24/avr-hardware-timer-tricked-into-one-shot/
+ * OC2B rises when TCNT2 reaches OCR2B and falls when it wraps to 0, where the timer stops (TOP = 0).
+ * Timer2 runs at CLK / 8 like Timer1 and their prescalers are reset together, so writing
+ * TCNT2 = OCR2B - n starts the pulse exactly n Timer1 ticks later. */
+#define HAL_PULSE_START (256u - HAL_PULSE_WIDTH_TICKS) // OCR2B
+#define HAL_PULSE_MAX_DELAY_TICKS (HAL_PULSE_START - 1u)
+
+static inline void hal_pulse_timer_init() {
+	TCCR2A = (1 << COM2B1) | (1 << COM2B0) | (1 << WGM21) | (1 << WGM20);
+	TCCR2B = (1 << WGM22) | (1 << CS21); // CLK / 8
+	OCR2A = 0;
+	OCR2B = HAL_PULSE_START;
+}
+
+static inline uint8_t hal_pulse_timer_is_running() {
+	return TCNT2 != 0;
+}
+
+/* the pulse rises at Timer1 time 'due', or one tick from now when it is already due;
+ * interrupts must be disabled, the delay between reading TCNT1 and writing TCNT2 is below one tick */
+static inline void hal_pulse_timer_fire_at(uint16_t due) {
+	int16_t delay = due - TCNT1;
+	if (delay < 1) {
+		delay = 1; // TCNT2 = OCR2B would block the compare match
+	} else if (delay > (int16_t)HAL_PULSE_MAX_DELAY_TICKS) {
+		delay = HAL_PULSE_MAX_DELAY_TICKS;
+	}
+	TCNT2 = HAL_PULSE_START - delay;
+	TIFR2 = 0xFF; // clear all flags
+}
+
+/******* Timer 0, 1 and 2 prescalers ******/
+/* configure Timer1 and Timer2 between the two calls, they then count in step */
+static inline void hal_timers_halt() {
+	GTCCR = (1 << TSM) | (1 << PSRASY) | (1 << PSRSYNC);
+}
+
+static inline void hal_timers_start() {
+	GTCCR = 0;
+}
+
+/******* Timer 1 - free running step timer ******/
+static inline void hal_step_timer_init() {
+	TCCR1A = 0; // normal mode, output compare pins disconnected
+	TCCR1B = 1 << CS11; // CLK / 8
+}
+
+/* TIMER1_COMPA_vect fires 'ticks' after the previous compare match, or after now when idle.
+ * A deadline that has already passed (the interrupt was held up longer than 'ticks') is moved
+ * to now, otherwise the match would come a full timer wrap (32.8 ms) later.
+ * Call from an interrupt only, the 16 bit registers are not accessed atomically. */
+static inline void hal_step_timer_schedule_next(uint16_t ticks) {
+	uint16_t now = TCNT1;
+	uint16_t next = (TIMSK1 & (1 << OCIE1A)) ? OCR1A + ticks : now + ticks;
+	if ((int16_t)(next - now) < (int16_t)HAL_STEP_TIMER_MIN_TICKS) {
+		next = now + HAL_STEP_TIMER_MIN_TICKS;
+	}
+	OCR1A = next;
+}
+
+/* the same guard against a deadline that is already too close */
+static inline void hal_step_timer_schedule_at(uint16_t ticks) {
+	uint16_t now = TCNT1;
+	if ((int16_t)(ticks - now) < (int16_t)HAL_STEP_TIMER_MIN_TICKS) {
+		ticks = now + HAL_STEP_TIMER_MIN_TICKS;
+	}
+	OCR1A = ticks;
+}
+
+/* time of the compare match that entered TIMER1_COMPA_vect; call from the interrupt only */
+static inline uint16_t hal_step_timer_compare() {
+	return OCR1A;
+}
+
+/* call from an interrupt only */
+static inline uint16_t hal_step_timer_now() {
+	return TCNT1;
+}
+
+static inline void hal_step_timer_overflow_irq_enable() {
+	TIMSK1 |= 1 << TOIE1;
+}
+
+static inline uint8_t hal_step_timer_overflow_is_pending() {
+	return TIFR1 & (1 << TOV1);
+}
+
+static inline void hal_step_timer_irq_enable() {
+	TIFR1 = 1 << OCF1A; // forget a stale compare match
+	TIMSK1 |= 1 << OCIE1A;
+}
+
+static inline void hal_step_timer_irq_disable() {
+	TIMSK1 &= ~(1 << OCIE1A);
+}
+
+static inline uint8_t hal_step_timer_irq_is_enabled() {
+	return TIMSK1 & (1 << OCIE1A);
+}
+
+/******* Timer 0 - 2 ms system tick ******/
+static inline void hal_tick_timer_init() {
+	OCR0A = 125u; // 16 MHz / 256 / 125 = 2 ms
+	TCCR0A = 1 << WGM01; // Clear Timer on Compare Match (CTC) Mode
+	TCCR0B = 1 << CS02; // CLK / 256x
+	TIMSK0 = 1 << OCIE0A; // enable interrupt
+}
+
+/******* USART0 - telemetry ******/
+/* transmitter only on PD1, 8N1 at 1 Mbaud: 16 MHz / 8 / (UBRR + 1) with U2X, no baud rate error */
+#define HAL_UART_UBRR 1u
+
+static inline void hal_uart_init() {
+	UBRR0 = HAL_UART_UBRR;
+	UCSR0A = 1 << U2X0;
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+	UCSR0B = 1 << TXEN0;
+}
+
+static inline void hal_uart_write(uint8_t value) {
+	UDR0 = value;
+}
+
+/* USART_UDRE_vect fires while the data register is empty */
+static inline void hal_uart_irq_enable() {
+	UCSR0B |= 1 << UDRIE0;
+}
+
+static inline void hal_uart_irq_disable() {
+	UCSR0B &= ~(1 << UDRIE0);
+}
+
+/******* power-fail sense ******/
+/* PC1 (ADC1) gets the unregulated supply through a divider that gives 1.1 V well above the
+ * regulator dropout. The analog comparator compares it with the internal bandgap and
+ * ANALOG_COMP_vect fires when it falls below; ACO = 1 while the supply is failing. */
+static inline void hal_power_sense_init() {
+	DDRC &= ~(1 << DDC1);
+	PORTC &= ~(1 << PORTC1); // no pull-up on the divider
+	DIDR0 |= 1 << ADC1D;
+	ADCSRA &= ~(1 << ADEN);
+	ADCSRB |= 1 << ACME; // negative input from the ADC multiplexer
+	ADMUX = 1 << MUX0; // ADC1
+	ACSR = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0); // bandgap on the positive input, rising output edge
+}
+
+static inline uint8_t hal_power_is_failing() {
+	return ACSR & (1 << ACO);
+}
+
+static inline void hal_power_irq_enable() {
+	ACSR |= 1 << ACI; // forget the edges of the power-up
+	ACSR |= 1 << ACIE;
+}
+
+/******* EEPROM split erase and write ******/
+/* A write into an erased byte takes 1.8 ms instead of 3.4 ms of the atomic erase and write.
+ * Interrupts must be disabled, EEMPE and EEPE have to be set within 4 cycles. */
+static inline void hal_eeprom_erase_byte(uint16_t address) {
+	while (EECR & (1 << EEPE))
+		;
+	EEAR = address;
+	EECR = 1 << EEPM0; // erase only
+	EECR |= 1 << EEMPE;
+	EECR |= 1 << EEPE;
+}
+
+static inline void hal_eeprom_write_erased_byte(uint16_t address, uint8_t value) {
+	while (EECR & (1 << EEPE))
+		;
+	EEAR = address;
+	EEDR = value;
+	EECR = 1 << EEPM1; // write only
+	EECR |= 1 << EEMPE;
+	EECR |= 1 << EEPE;
+}
+
+static inline void hal_eeprom_wait() {
+	while (EECR & (1 << EEPE))
+		;
+}
+
+/******* reset ******/
+/* the watchdog stays enabled after its reset, call first in main() */
+static inline void hal_watchdog_off() {
+	MCUSR &= ~(1 << WDRF);
+	wdt_disable();
+}
+
+static inline void hal_reset() {
+	wdt_enable(WDTO_15MS);
+	while (1)
+		;
+}
+
+/******* ISR timing probes ******/
+/* Build with ISR_PROBES defined to hold a pin high for the whole run of an interrupt handler.
+ * Pulse widths give the execution time and jitter of each vector on a logic analyzer or in a
+ * simavr VCD trace; the distance from the encoder probe to the PD3 edge is the step latency.
+ * PB3 = INT0_vect and PCINT0_vect, PB4 = TIMER1_COMPA_vect, PD5 = TIMER0_COMPA_vect */
+#ifdef ISR_PROBES
+static inline void hal_probes_init() {
+	DDRB |= (1 << DDB3) | (1 << DDB4);
+	DDRD |= 1 << DDD5;
+	PORTB &= ~((1 << PORTB3) | (1 << PORTB4));
+	PORTD &= ~(1 << PORTD5);
+}
+static inline void hal_probe_encoder_begin() { PORTB |= 1 << PORTB3; }
+static inline void hal_probe_encoder_end() { PORTB &= ~(1 << PORTB3); }
+static inline void hal_probe_support_begin() { PORTB |= 1 << PORTB4; }
+static inline void hal_probe_support_end() { PORTB &= ~(1 << PORTB4); }
+static inline void hal_probe_tick_begin() { PORTD |= 1 << PORTD5; }
+static inline void hal_probe_tick_end() { PORTD &= ~(1 << PORTD5); }
+#else
+static inline void hal_probes_init() {}
+static inline void hal_probe_encoder_begin() {}
+static inline void hal_probe_encoder_end() {}
+static inline void hal_probe_support_begin() {}
+static inline void hal_probe_support_end() {}
+static inline void hal_probe_tick_begin() {}
+static inline void hal_probe_tick_end() {}
+#endif
+
+#endif /* HAL_AVR_H_ */
@@ -0,0 +1,119 @@
+#include "i2c_queue.h"
+#include "cpu.h"
+#include <avr/interrupt.h>
+#include <compat/twi.h>
+#include <util/atomic.h>
+
+#define I2C_QUEUE_SIZE 128u // power of two
+
+/* Ring buffer of transactions stored as [address][length][data...]. The main loop writes a whole
+ * transaction before it moves the head, so the interrupt never sees a half written one. */
+static uint8_t i2c_queue[I2C_QUEUE_SIZE];
+static volatile uint8_t i2c_queue_head = 0u; // written by the main loop only
+static volatile uint8_t i2c_queue_tail = 0u; // written by the interrupt only
+static volatile uint8_t i2c_queue_busy = 0u; // the interrupt is sending
+static volatile uint8_t i2c_queue_finished = 0u; // can overflow
+static uint8_t i2c_queue_queued = 0u; // can overflow
+static uint8_t i2c_queue_remaining = 0u; // data bytes left of the transaction being sent
+static volatile uint16_t i2c_queue_errors = 0u;
+
+void i2c_queue_init(void) {
+	TWSR = 0; /* no prescaler */
+	TWBR = ((F_CPU/I2C_SCL_CLOCK)-16)/2; /* must be > 10 for stable operation */
+}
+
+static uint8_t i2c_queue_put(uint8_t head, uint8_t value) {
+	uint8_t next = (head + 1u) & (I2C_QUEUE_SIZE - 1u);
+	while (next == i2c_queue_tail)
+		; // full, wait for the interrupt
+	i2c_queue[head] = value;
+	return next;
+}
+
+uint8_t i2c_queue_write(uint8_t address, const uint8_t *data, uint8_t length) {
+	if (length > I2C_QUEUE_MAX_LENGTH) {
+		length = I2C_QUEUE_MAX_LENGTH;
+	}
+
+	uint8_t head = i2c_queue_head;
+	head = i2c_queue_put(head, address);
+	head = i2c_queue_put(head, length);
+	for (uint8_t i = 0; i < length; i++) {
+		head = i2c_queue_put(head, data[i]);
+	}
+	i2c_queue_head = head;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!i2c_queue_busy) {
+			i2c_queue_busy = 1u;
+			while (TWCR & (1 << TWSTO))
+				; // the previous STOP is still on the bus
+			TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+		}
+	}
+	return ++i2c_queue_queued;
+}
+
+uint8_t i2c_queue_is_done(uint8_t ticket) {
+	return (int8_t)(i2c_queue_finished - ticket) >= 0;
+}
+
+void i2c_queue_flush(void) {
+	while (i2c_queue_busy)
+		;
+}
+
+uint16_t i2c_queue_get_errors(void) {
+	uint16_t errors;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		errors = i2c_queue_errors;
+	}
+	return errors;
+}
+
+static uint8_t i2c_queue_pop() {
+	uint8_t tail = i2c_queue_tail;
+	uint8_t value = i2c_queue[tail];
+	i2c_queue_tail = (tail + 1u) & (I2C_QUEUE_SIZE - 1u);
+	return value;
+}
+
+/* STOP the finished transaction and START the next one right after it, if there is one */
+static void i2c_queue_next() {
+	i2c_queue_finished++;
+	if (i2c_queue_tail != i2c_queue_head) {
+		TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+	} else {
+		TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN);
+		i2c_queue_busy = 0u;
+	}
+}
+
+ISR(TWI_vect) {
+	switch (TW_STATUS) {
+		case TW_START:
+		case TW_REP_START:
+			TWDR = (i2c_queue_pop() << 1) | TW_WRITE;
+			i2c_queue_remaining = i2c_queue_pop();
+			TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+			break;
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			if (i2c_queue_remaining) {
+				i2c_queue_remaining--;
+				TWDR = i2c_queue_pop();
+				TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+			} else {
+				i2c_queue_next();
+			}
+			break;
+		default: // NACK or bus error, drop the rest of the transaction
+			i2c_queue_errors++;
+			while (i2c_queue_remaining) {
+				i2c_queue_remaining--;
+				i2c_queue_pop();
+			}
+			i2c_queue_next();
+			break;
+	}
+}
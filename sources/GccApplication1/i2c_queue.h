@@ -0,0 +1,35 @@
+#ifndef I2C_QUEUE_H_
+#define I2C_QUEUE_H_
+
+#include <stdint.h>
+
+/*
+ * Interrupt driven I2C master. Transactions (START, address + write, data, STOP) are copied
+ * into a ring buffer and sent in the background by ISR(TWI_vect), one after another.
+ * Needs global interrupts enabled.
+ */
+
+/* I2C clock in Hz, 100 kHz as the PCF8574 on the display backpack is specified. Building with
+ * I2C_SCL_CLOCK=400000L quadruples the display throughput but leaves the HD44780 only 45 us
+ * between two writes, barely above its 37 us at the typical oscillator frequency; see lcd.c. */
+#ifndef I2C_SCL_CLOCK
+#define I2C_SCL_CLOCK 100000L
+#endif
+
+#define I2C_QUEUE_MAX_LENGTH 120u // data bytes of one transaction
+
+void i2c_queue_init(void);
+
+/* queues the transaction and returns its ticket; waits only while the ring buffer is full */
+uint8_t i2c_queue_write(uint8_t address, const uint8_t *data, uint8_t length);
+
+/* completion flag of a transaction returned by i2c_queue_write() */
+uint8_t i2c_queue_is_done(uint8_t ticket);
+
+/* waits until all queued transactions are sent */
+void i2c_queue_flush(void);
+
+/* transactions not acknowledged by the device or broken by a bus error, can overflow */
+uint16_t i2c_queue_get_errors(void);
+
+#endif /* I2C_QUEUE_H_ */
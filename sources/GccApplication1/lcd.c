@@ -1,14 +1,22 @@
 #include "lcd.h"
 
-#include "i2cmaster.h"
+#include "i2c_queue.h"
+#include "main.h"
 
-#include <stdarg.h>
-#include <stdio.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 
 static uint8_t lcd_displayparams;
-static char lcd_buffer[LCD_COL_COUNT + 1];
+
+/* Shadow framebuffer: lcd_set_cursor/lcd_puts/lcd_put_* only draw into lcd_frame and mark the
+ * changed cells; lcd_flush() sends the runs of changed cells to the display. */
+static char lcd_frame[LCD_ROW_COUNT][LCD_COL_COUNT];
+static uint32_t lcd_dirty[LCD_ROW_COUNT]; // bit per column
+static uint8_t lcd_frame_col;
+static uint8_t lcd_frame_row;
+static uint8_t lcd_display_col = LCD_COL_COUNT; // DDRAM address of the display, LCD_COL_COUNT = unknown
+static uint8_t lcd_display_row;
 
 #define BACKLIGHT_ON (1 << LCD_BACKLIGHT)
 #define RS_ON (1 << LCD_RS)
@@ -16,20 +24,51 @@ static char lcd_buffer[LCD_COL_COUNT + 1];
 #define EN_ON (1 << LCD_EN)
 #define EN_OFF 0x00
 
+/* Burst transport: nibbles are collected into one I2C transaction, two PCF8574 bytes each (EN high,
+ * EN low; HD44780 latches the data on the falling edge). A write executes from the falling edge of
+ * its low nibble, and the next falling edge comes two bytes later. One byte takes 9 SCL periods,
+ * 90 us at 100 kHz, so the 37 us of a write or any fast command have passed and the bus itself
+ * paces the display - no delays. Only lcd_clear() and lcd_return_home() (1.52 ms) wait. A full row
+ * with its cursor command fits into one transaction. */
+#define LCD_BURST_LENGTH 96u // <= I2C_QUEUE_MAX_LENGTH
+
+static uint8_t lcd_burst[LCD_BURST_LENGTH];
+static uint8_t lcd_burst_length;
+static uint8_t lcd_burst_rs = 0xFF; // RS of the last byte sent to the expander, 0xFF = unknown (outputs are high after reset)
+static uint8_t lcd_burst_hold; // lcd_flush() collects a whole row before it sends
+
+static void lcd_transmit(void) {
+	if (lcd_burst_length) {
+		i2c_queue_write(LCD_DISPLAY_ADDRESS, lcd_burst, lcd_burst_length);
+		lcd_burst_length = 0;
+	}
+}
+
 void lcd_write_nibble(uint8_t nibble, uint8_t rs) {
-	i2c_write(rs | EN_OFF | BACKLIGHT_ON | (nibble << 4));
-	i2c_write(rs | EN_ON | BACKLIGHT_ON | (nibble << 4));
-	i2c_write(rs | EN_OFF | BACKLIGHT_ON | (nibble << 4));
-	_delay_ms(0.3);	// If delay less than this value, the data is not correctly displayed
+	uint8_t data = rs | BACKLIGHT_ON | (nibble << 4);
+
+	if (lcd_burst_length > LCD_BURST_LENGTH - 3u) {
+		lcd_transmit();
+	}
+	if (rs != lcd_burst_rs) {
+		lcd_burst[lcd_burst_length++] = data | EN_OFF; // RS must settle before EN rises (t_AS)
+		lcd_burst_rs = rs;
+	}
+	lcd_burst[lcd_burst_length++] = data | EN_ON;
+	lcd_burst[lcd_burst_length++] = data | EN_OFF;
 }
 
 void lcd_send(uint8_t value, uint8_t rs) {
 	lcd_write_nibble(value >> 4, rs);
 	lcd_write_nibble(value, rs);
+	if (!lcd_burst_hold) {
+		lcd_transmit();
+	}
 }
 
 void lcd_command(uint8_t command) {
   lcd_send(command, RS_OFF);
+  lcd_display_col = LCD_COL_COUNT; // the command may have moved the cursor
 }
 
 void lcd_write(uint8_t value) {
@@ -49,11 +88,21 @@ void lcd_off(void) {
 
 void lcd_clear(void) {
 	lcd_command(LCD_CLEARDISPLAY);
+	for (uint8_t row = 0; row < LCD_ROW_COUNT; row++) {
+		for (uint8_t col = 0; col < LCD_COL_COUNT; col++) {
+			lcd_frame[row][col] = ' ';
+		}
+		lcd_dirty[row] = 0;
+	}
+	lcd_frame_col = 0;
+	lcd_frame_row = 0;
+	i2c_queue_flush();
 	_delay_ms(2);
 }
 
 void lcd_return_home(void) {
 	lcd_command(LCD_RETURNHOME);
+	i2c_queue_flush();
 	_delay_ms(2);
 }
 
@@ -112,32 +161,135 @@ void lcd_create_char(uint8_t location, uint8_t *charmap) {
 	}
 }
 
-void lcd_set_cursor(uint8_t col, uint8_t row) {
+static void lcd_move_display_cursor(uint8_t col, uint8_t row) {
 	static uint8_t offsets[] = { 0x00, 0x40, 0x14, 0x54 };
 
+	if ((col != lcd_display_col) || (row != lcd_display_row)) {
+		lcd_command(LCD_SETDDRAMADDR | (col + offsets[row]));
+		lcd_display_col = col;
+		lcd_display_row = row;
+	}
+}
+
+void lcd_set_cursor(uint8_t col, uint8_t row) {
 	if (row >= LCD_ROW_COUNT) {
 		row = LCD_ROW_COUNT - 1;
 	}
 
-	lcd_command(LCD_SETDDRAMADDR | (col + offsets[row]));
+	lcd_frame_col = col;
+	lcd_frame_row = row;
+}
+
+void lcd_put_char(char c) {
+	if (lcd_frame_col >= LCD_COL_COUNT) {
+		return;
+	}
+	if (lcd_frame[lcd_frame_row][lcd_frame_col] != c) {
+		lcd_frame[lcd_frame_row][lcd_frame_col] = c;
+		lcd_dirty[lcd_frame_row] |= 1ul << lcd_frame_col;
+	}
+	lcd_frame_col++;
 }
 
 void lcd_puts(char *string) {
 	for (char *it = string; *it; it++) {
-		lcd_write(*it);
+		lcd_put_char(*it);
 	}
 }
 
-void lcd_printf(char *format, ...) {
-	va_list args;
+void lcd_puts_P(const char *string) {
+	for (char c; (c = pgm_read_byte(string)); string++) {
+		lcd_put_char(c);
+	}
+}
 
-	va_start(args, format);
-	vsnprintf(lcd_buffer, LCD_COL_COUNT + 1, format, args);
-	va_end(args);
+/****** number fields ******/
+/* Fixed-format replacements of printf: the digits are written straight into the framebuffer.
+ * width is the minimal field width like in printf, negative = left aligned. */
+#define LCD_NUMBER_DIGITS 11u // 4294967295 and a decimal point
+
+static void lcd_put_field(char *digits, uint8_t length, char sign, int8_t width, char fill) {
+	uint8_t field = length + (sign ? 1u : 0u);
+
+	if (width >= 0) {
+		if (sign && (fill == '0')) {
+			lcd_put_char(sign); // -0012
+			sign = 0;
+		}
+		for (; field < (uint8_t)width; field++) {
+			lcd_put_char(fill);
+		}
+	}
+	if (sign) {
+		lcd_put_char(sign);
+	}
+	while (length) {
+		lcd_put_char(digits[--length]);
+	}
+	for (; (width < 0) && (field < (uint8_t)-width); field++) {
+		lcd_put_char(' ');
+	}
+}
+
+/* digits in reverse order, at least decimals + 1 of them with a point after the decimals */
+static uint8_t lcd_format_digits(char *digits, uint32_t value, uint8_t decimals) {
+	uint8_t length = 0;
+	do {
+		if (decimals && (length == decimals)) {
+			digits[length++] = '.';
+		}
+		if (value <= UINT16_MAX) {
+			uint16_t short_value = value; // 16 bit division is several times faster on AVR
+			digits[length++] = '0' + (short_value % 10u);
+			value = short_value / 10u;
+		} else {
+			digits[length++] = '0' + (value % 10u);
+			value /= 10u;
+		}
+	} while (value || (length <= decimals));
+	return length;
+}
 
-	lcd_puts(lcd_buffer);
+/* %[-]<width>lu, fill '0' gives %0<width>lu */
+void lcd_put_unsigned(uint32_t value, int8_t width, char fill) {
+	char digits[LCD_NUMBER_DIGITS];
+	lcd_put_field(digits, lcd_format_digits(digits, value, 0), 0, width, fill);
 }
 
+/* %[-]<width>li */
+void lcd_put_signed(int32_t value, int8_t width) {
+	char digits[LCD_NUMBER_DIGITS];
+	uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+	lcd_put_field(digits, lcd_format_digits(digits, magnitude, 0), (value < 0) ? '-' : 0, width, ' ');
+}
+
+/* value / 10^decimals as %<width>.<decimals>f, without the float library */
+void lcd_put_fixed(uint32_t value, uint8_t decimals, int8_t width) {
+	char digits[LCD_NUMBER_DIGITS];
+	lcd_put_field(digits, lcd_format_digits(digits, value, decimals), 0, width, ' ');
+}
+
+/* sends the changed cells; a gap of one unchanged cell is rewritten, it costs as much as a cursor jump */
+void lcd_flush(void) {
+	for (uint8_t row = 0; row < LCD_ROW_COUNT; row++) {
+		uint32_t dirty = lcd_dirty[row];
+		lcd_dirty[row] = 0;
+		lcd_burst_hold = 1;
+		for (uint8_t col = 0; dirty; col++, dirty >>= 1) {
+			if ((dirty & 1) || ((dirty & 2) && (col == lcd_display_col) && (row == lcd_display_row))) {
+				lcd_move_display_cursor(col, row);
+				lcd_write(lcd_frame[row][col]);
+				lcd_display_col++;
+			}
+		}
+		lcd_burst_hold = 0;
+		lcd_transmit(); // one transaction per row
+	}
+
+	if (lcd_displayparams & (LCD_CURSORON | LCD_BLINKON)) {
+		lcd_move_display_cursor(lcd_frame_col, lcd_frame_row); // show the cursor where the frame cursor is
+	}
+}
 
 void lcd_init(void) {
 
@@ -149,15 +301,22 @@ void lcd_init(void) {
   //_delay_ms(4.1);
 
   lcd_write_nibble(0x03, RS_OFF); // Switch to 4 bit mode
+  lcd_transmit();
+  i2c_queue_flush();
   _delay_ms(4.1);
 
   lcd_write_nibble(0x03, RS_OFF); // 2nd time
+  lcd_transmit();
+  i2c_queue_flush();
   _delay_ms(4.1);
 
   lcd_write_nibble(0x03, RS_OFF); // 3rd time
+  lcd_transmit();
+  i2c_queue_flush();
   _delay_ms(4.1);
 
   lcd_write_nibble(0x02, RS_OFF); // Set 8-bit mode (?)
+  lcd_transmit();
 
   lcd_command(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS);
 
@@ -79,5 +79,11 @@ void lcd_create_char(uint8_t location, uint8_t *charmap);
 
 void lcd_set_cursor(uint8_t col, uint8_t row);
 
+void lcd_put_char(char c);
 void lcd_puts(char *string);
-void lcd_printf(char *format, ...);
+void lcd_puts_P(const char *string); // from flash
+void lcd_put_unsigned(uint32_t value, int8_t width, char fill);
+void lcd_put_signed(int32_t value, int8_t width);
+void lcd_put_fixed(uint32_t value, uint8_t decimals, int8_t width);
+
+void lcd_flush(void);
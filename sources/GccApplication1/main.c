@@ -5,115 +5,47 @@
  *
  * Driver provede operaci, kdyz Pulse na nabezne hrane (0 -> 1)
  *
- * Timer 0 - 1x za 1ms - pro pocitani otacek za minutu
- * Timer 1 - 
- * Timer 2 - puls pro driver
- * I2C - Display Hitachi HD44780 na adrese 0x27 (39)
+ * Timer 0 - 1x za 2ms - blikani ledky, osetreni zakmitu tlacitek (buttons.c), takt hlavni smycky (scheduler.c), mezi takty CPU spi (idle)
+ * Timer 1 - casovani kroku motoru (volne bezici, CLK/8, rampa zrychleni) a mereni otacek (casove znacky v preruseni snimace)
+ * Timer 2 - puls pro driver 10 us, nabezna hrana presne v case naplanovanem Timerem 1 (stejna preddelicka)
+ * I2C - Display Hitachi HD44780 na adrese 0x27 (39), posila se na pozadi z preruseni TWI (i2c_queue.c)
  * PortB.5 = ledka primo na desce
  * PortC.2 = Driver Enable
  * PortD.3 = Driver Pulse
  * PortC.0 = Driver Direction
- * PortD.2 = zluty kabel od snimace otacek
- * PortB.2 = zeleny kabel od snimace otacek
+ * PortD.2 = zluty kabel od snimace otacek (INT0, obe hrany)
+ * PortB.2 = zeleny kabel od snimace otacek (PCINT2, obe hrany) - kvadraturni dekodovani 4x
+ * PortB.3, PortB.4, PortD.5 = mereni delky preruseni (jen s ISR_PROBES, viz hal.h)
+ * PortD.1 = TXD - telemetrie 1 Mbaud, binarni ramce kazde 2 ms (jen s TELEMETRY, telemetry.c, tools/telemetry_decode.py)
+ * PortC.1 = hlidani napajeni (jen s POWERFAIL) - delic z nestabilizovaneho napajeni, komparator proti 1.1 V, pri vypadku se ulozi poloha do EEPROM
  */ 
 
 #include "cpu.h"
-#include <avr/io.h>
-#include <avr/portpins.h>
-#include <avr/interrupt.h>
 #include <stdbool.h>
-#include <util/atomic.h>
-#include <util/delay.h>
 #include "main.h"
-#include "i2cmaster.h"
+#include "i2c_queue.h"
 #include "lcd.h"
 #include "buttons.h"
 #include "led.h"
 #include "setup_menu.h"
 #include "revolutions.h"
 #include "support.h"
+#include "spindle.h"
+#include "hal.h"
+#include "threading.h"
+#include "powerfail.h"
+#include "diagnostics.h"
+#include "telemetry.h"
+#include "scheduler.h"
 
 static /*volatile*/ mode_t mode = LEFT;
 
-
-
-/******* Angle and position ******/
-#define END_POSITION_INIT_VALUE (UINT32_MAX - STEPS_FOR_ONE_TURN) 
-static /*volatile*/ uint32_t end_position = END_POSITION_INIT_VALUE;
-
-static /*volatile*/ uint32_t current_spindle_revolution_steps;
-static /*volatile*/ uint16_t spindle_revolution_steps_overflow; //can overflow
-
-uint32_t get_end_position() {
-	return end_position;
-}
-
-uint16_t get_spindle_revolution_steps_overflow() {
-	return spindle_revolution_steps_overflow;
-}
-
-//uint32_t get_current_spindle_revolution_steps() {
-//	return current_spindle_revolution_steps;
-//}
-
-static void spindle_try_to_set_position_limit() {
-	if (button_1_is_pressed() && (end_position == END_POSITION_INIT_VALUE)) {
-		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-			end_position = current_spindle_revolution_steps;
-		}
-	}
-}
-
-static uint8_t spindle_rotate_left() {
-	uint8_t direction = PINB & (1 << PD2);
-	if (mode == LEFT) {
-		return direction;
-	} else {
-		return !direction;
-	}	
-}
-
-static void schedule_support_position_recalculation() {
-	TIMSK2 |= 1 << OCIE2A;
-}
-
-static void spindle_position_recalculation() {
-	if (spindle_rotate_left()) { // rotating left or right?
-		spindle_revolution_steps_overflow++;
-		if (current_spindle_revolution_steps >= end_position + (STEPS_FOR_ONE_TURN - 1)) {
-			current_spindle_revolution_steps -= STEPS_FOR_ONE_TURN - 1;
-		} else {
-			current_spindle_revolution_steps++;	
-		}
-	} else {
-		spindle_revolution_steps_overflow--;
-		if (current_spindle_revolution_steps == 0)  {
-			current_spindle_revolution_steps += STEPS_FOR_ONE_TURN - 1;
-		} else {
-			current_spindle_revolution_steps--;
-		}
-	}
-	
-	recalculate_support_position(current_spindle_revolution_steps);
-	schedule_support_position_recalculation();
-}
-	
-//Rotary Encoder interrupt
-ISR(INT0_vect) { //Interrupt Vectors in ATmega328P - page 48
-	spindle_position_recalculation();
-}
-
-static void init_step_counting() {
-	// Phase wire 1 - External Interrupts External Interrupts - page 58
-	EICRA |= (1 << ISC01) | (1 << ISC00); // INT0 on rising edge
-	EIMSK |= (1 << INT0); // Enable INT0
-	
-	// Phase wire 2 
-	DDRB &= ~(1 << PD2); // PIN as input
-}
-
 /****** Display information *********/
 static void display_redraw() {
+	uint16_t revolutions;
+	uint16_t angle;
+	get_spindle_angle(&revolutions, &angle);
+
 	char mode_char;
 	if (mode == LEFT) {
 		mode_char = 'L';
@@ -123,15 +55,79 @@ static void display_redraw() {
 		mode_char = '?';
 	}
 	lcd_set_cursor(0, 0);
-	lcd_printf("vreteno: %4u  %5u", (uint16_t)(current_spindle_revolution_steps % STEPS_FOR_ONE_TURN), (uint16_t)(current_spindle_revolution_steps / STEPS_FOR_ONE_TURN));
+	lcd_puts("vreteno: ");
+	lcd_put_unsigned(angle, 4, ' ');
+	lcd_puts("  ");
+	lcd_put_unsigned(revolutions, 5, ' ');
 	lcd_set_cursor(0, 1);
-	lcd_printf("%3u/%-3u%c%5i ot/min", get_configured_multiplier(), get_configured_divisor(), mode_char, get_revolutions_per_minute());
+	if (get_configured_pitch_name()) {
+		lcd_puts_P(get_configured_pitch_name());
+	} else {
+		lcd_put_unsigned(get_configured_multiplier(), 3, ' ');
+		lcd_put_char('/');
+		lcd_put_unsigned(get_configured_divisor(), -3, ' ');
+	}
+	int16_t rpm = get_revolutions_per_minute();
+	uint16_t rpm_abs = (rpm < 0) ? -rpm : rpm;
+	uint16_t max_rpm = get_max_revolutions_per_minute();
+	lcd_put_char(mode_char);
+	lcd_put_signed(rpm, 5);
+	lcd_put_char((rpm_abs > max_rpm) ? '!' : '/'); // '!' = too fast, the support or the encoder cannot follow
+	lcd_put_unsigned((max_rpm > 9999u) ? 9999u : max_rpm, -4, ' ');
+	lcd_puts("ot");
 	lcd_set_cursor(0, 2);
-	lcd_printf("support: %11lu", get_actual_support_position());
+	lcd_puts("support: ");
+	lcd_put_unsigned(get_actual_support_position(), 11, ' ');
 	lcd_set_cursor(0, 3);
-	lcd_printf("%2u %5i %11lu", button_status(), (int16_t) (get_required_support_position() - get_actual_support_position()), get_required_support_position());
+	if (support_alarm_is_active()) {
+		lcd_puts("ALARM odchylka ");
+		lcd_put_unsigned(get_following_error_max(), 5, ' ');
+	} else if (threading_is_enabled()) {
+		threading_display();
+	} else {
+		lcd_put_signed((int16_t) (get_required_support_position() - get_actual_support_position()), 5);
+		lcd_puts(" max");
+		lcd_put_unsigned(get_following_error_max(), 4, ' ');
+		lcd_puts(" rms");
+		lcd_put_unsigned(get_following_error_rms(), 3, ' ');
+	}
+	lcd_flush();
+}
+
+/****** main loop tasks *********/
+static void task_end_position() {
+	if (button_1_is_pressed()) {
+		spindle_set_end_position();
+	}
+}
+
+static void task_buttons() {
+	threading_update();
+	diagnostics_update();
 }
 
+static void task_lead() {
+	if (get_configured_prediction()) {
+		support_update_lead(get_spindle_steps_per_second());
+	}
+}
+
+static void task_display() {
+	if (diagnostics_is_shown()) {
+		diagnostics_display();
+	} else {
+		display_redraw();
+	}
+}
+
+static scheduler_task_t main_tasks[] = {
+	{ task_end_position, 1u, 0u }, // 2 ms
+	{ task_buttons, 5u, 0u }, // 10 ms
+	{ task_lead, 5u, 0u }, // 10 ms, the speed window is 1/8 turn
+	{ task_display, 25u, 0u }, // 50 ms, 20 frames per second
+	{ telemetry_send, 1u, 0u }, // 2 ms, the frame sampled by the tick
+};
+
 static void display_init_information() {
 	lcd_clear();
 	lcd_disable_cursor();
@@ -142,33 +138,41 @@ static void display_init_information() {
 /************** main **************/
 
 int main(void) {
-	PORTB = 0xFF; /* enable pull up on PORTB */
-	PORTC = 0xFF; /* enable pull up on PORTC */
-	PORTD = 0xFF; /* enable pull up on PORTD */
+	hal_watchdog_off();
+	hal_pull_ups_init();
 				
 	init_buttons();
 	led_init();
-	i2c_init();
-	i2c_start_wait(LCD_DISPLAY_ADDRESS << 1 | I2C_WRITE);
+	hal_probes_init();
+	i2c_queue_init();
+	telemetry_init();
+	init_revolution_calculation(); // the tick debounces the buttons from now on, also in the menu
+	hal_irq_enable(); // the display is driven from the TWI interrupt
 	lcd_init();
 	support_init();
 	
-	user_setup_values();
-	support_set_fraction(get_configured_fraction());
+	powerfail_init();
+	uint8_t menu_opened = user_setup(); // the saved configuration, the menu only on request
+	support_set_fraction(get_configured_numerator(), get_configured_denominator(), get_configured_prediction());
 	mode = get_configured_mode();
+
+	powerfail_snapshot_t snapshot;
+	if (!menu_opened && powerfail_load(&snapshot) && powerfail_ask_resume(&snapshot)) {
+		spindle_restore(snapshot.spindle_steps, snapshot.end_position);
+		support_restore(snapshot.spindle_steps, snapshot.support_position);
+	}
+	powerfail_arm();
 	
 	display_init_information();
 	
-	init_step_counting();
-	init_revolution_calculation();
-	sei(); // enable interrupts
+	init_step_counting(mode == LEFT);
 
 
 	//PORTC &= ~(1 << PORTC2); // disable Driver!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
     while (1) {
-		spindle_try_to_set_position_limit();
-		display_redraw();
+		scheduler_run(main_tasks, sizeof(main_tasks) / sizeof(main_tasks[0]));
+		diagnostics_main_loop();
     }
 	
 	/*
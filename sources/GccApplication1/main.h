@@ -5,11 +5,23 @@
 
 #define LCD_DISPLAY_ADDRESS 0x27
 
-#define SUPPORT_RECALCULATION_SPEED 128 // 16 MHz / 64 / 128 / 2 ~ 1 kHz   deleno 2 protoze v jednom kroku nastavime puls na Driveru na 1 a pak v druhem na 0
+#define DIAGNOSTICS 1 // 0 = without the counters and the diagnostics page, see diagnostics.h
+#define TELEMETRY 0 // 1 = binary state frames on the UART every 2 ms, see telemetry.c
+#define TELEMETRY_EDGES 0 // encoder steps buffered for the telemetry frames to replay a cut, a power of two up to 64, 0 = off
+#define POWERFAIL 0 // 1 = save the positions on power loss, needs the supply divider on PC1, see powerfail.c
 
-#define STEPS_FOR_ONE_TURN 600u
+#define STEPS_FOR_ONE_TURN 600u // encoder lines
+#define SPINDLE_STEPS_FOR_ONE_TURN (4u * STEPS_FOR_ONE_TURN) // quadrature decoding counts both edges of both wires
+#define SPINDLE_MAX_EDGES_PER_SECOND 12000ul // 300 ot/min, an edge must not come before the tick handler ends, see tools/bench
 
-uint16_t get_spindle_revolution_steps_overflow();
-uint32_t get_end_position();
+/* support stepper limits for the acceleration planner in support.c */
+#define SUPPORT_MAX_STEPS_PER_SECOND 5000u // 200 step motor at 1500 ot/min
+#define SUPPORT_ACCELERATION 20000ul // steps / s^2
+#define SUPPORT_FOLLOWING_ERROR_ALARM 100u // steps behind or ahead while cutting, 1.5 mm
+#define SUPPORT_ALARM_DISABLES_DRIVER 0 // 1 = the alarm also stops the support until reset
+
+/* leadscrew drive, tools/pitch_table.py generates pitch_table.c from these */
+#define SUPPORT_STEPS_PER_LEADSCREW_TURN 200u // motor steps including microstepping and gears
+#define LEADSCREW_PITCH_UM 3000u
 
 #endif /* MAIN_H_ */
\ No newline at end of file
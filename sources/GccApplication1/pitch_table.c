@@ -0,0 +1,88 @@
+/* Generated by tools/pitch_table.py, do not edit. */
+
+#include "pitch_table.h"
+#include "main.h"
+
+#if (LEADSCREW_PITCH_UM != 3000u) || (SUPPORT_STEPS_PER_LEADSCREW_TURN != 200u) || (SPINDLE_STEPS_FOR_ONE_TURN != 2400u)
+#error "pitch_table.c does not match main.h, run tools/pitch_table.py"
+#endif
+
+const pitch_t pitch_table[] PROGMEM = {
+	{ "0.20mm ",     1u,   180u },
+	{ "0.25mm ",     1u,   144u },
+	{ "0.30mm ",     1u,   120u },
+	{ "0.35mm ",     7u,   720u },
+	{ "0.40mm ",     1u,    90u },
+	{ "0.45mm ",     1u,    80u },
+	{ "0.50mm ",     1u,    72u },
+	{ "0.60mm ",     1u,    60u },
+	{ "0.70mm ",     7u,   360u },
+	{ "0.75mm ",     1u,    48u },
+	{ "0.80mm ",     1u,    45u },
+	{ "1.00mm ",     1u,    36u },
+	{ "1.25mm ",     5u,   144u },
+	{ "1.50mm ",     1u,    24u },
+	{ "1.75mm ",     7u,   144u },
+	{ "2.00mm ",     1u,    18u },
+	{ "2.50mm ",     5u,    72u },
+	{ "3.00mm ",     1u,    12u },
+	{ "3.50mm ",     7u,    72u },
+	{ "4.00mm ",     1u,     9u },
+	{ "4.50mm ",     1u,     8u },
+	{ "5.00mm ",     5u,    36u },
+	{ "5.50mm ",    11u,    72u },
+	{ "6.00mm ",     1u,     6u },
+	{ "4 TPI  ",   127u,   720u },
+	{ "4.5TPI ",   127u,   810u },
+	{ "5 TPI  ",   127u,   900u },
+	{ "6 TPI  ",   127u,  1080u },
+	{ "7 TPI  ",   127u,  1260u },
+	{ "8 TPI  ",   127u,  1440u },
+	{ "9 TPI  ",   127u,  1620u },
+	{ "10 TPI ",   127u,  1800u },
+	{ "11 TPI ",   127u,  1980u },
+	{ "11.5TPI",   127u,  2070u },
+	{ "12 TPI ",   127u,  2160u },
+	{ "13 TPI ",   127u,  2340u },
+	{ "14 TPI ",   127u,  2520u },
+	{ "16 TPI ",   127u,  2880u },
+	{ "18 TPI ",   127u,  3240u },
+	{ "19 TPI ",   127u,  3420u },
+	{ "20 TPI ",   127u,  3600u },
+	{ "22 TPI ",   127u,  3960u },
+	{ "24 TPI ",   127u,  4320u },
+	{ "26 TPI ",   127u,  4680u },
+	{ "27 TPI ",   127u,  4860u },
+	{ "28 TPI ",   127u,  5040u },
+	{ "32 TPI ",   127u,  5760u },
+	{ "36 TPI ",   127u,  6480u },
+	{ "40 TPI ",   127u,  7200u },
+	{ "44 TPI ",   127u,  7920u },
+	{ "48 TPI ",   127u,  8640u },
+	{ "56 TPI ",   127u, 10080u },
+	{ "64 TPI ",   127u, 11520u },
+	{ "72 TPI ",   127u, 12960u },
+	{ "80 TPI ",   127u, 14400u },
+	{ "m0.20  ",    71u,  4068u }, // error 8.5e-08
+	{ "m0.25  ",   912u, 41803u }, // error 1.8e-08
+	{ "m0.30  ",    71u,  2712u }, // error 8.5e-08
+	{ "m0.40  ",    71u,  2034u }, // error 8.5e-08
+	{ "m0.50  ",  1469u, 33667u }, // error 1.2e-09
+	{ "m0.60  ",    71u,  1356u }, // error 8.5e-08
+	{ "m0.70  ",  3009u, 49258u }, // error 3.2e-09
+	{ "m0.75  ",  2026u, 30955u }, // error 6.1e-09
+	{ "m0.80  ",    71u,  1017u }, // error 8.5e-08
+	{ "m1.00  ",  2938u, 33667u }, // error 1.2e-09
+	{ "m1.25  ",  5319u, 48761u }, // error 4.0e-09
+	{ "m1.50  ",  4407u, 33667u }, // error 1.2e-09
+	{ "m1.75  ",  7902u, 51743u }, // error 6.4e-10
+	{ "m2.00  ",  5876u, 33667u }, // error 1.2e-09
+	{ "m2.25  ",  6433u, 32763u }, // error 1.1e-09
+	{ "m2.50  ",  7345u, 33667u }, // error 1.2e-09
+	{ "m2.75  ", 15602u, 65013u }, // error 2.2e-09
+	{ "m3.00  ",  8814u, 33667u }, // error 1.2e-09
+	{ "m3.50  ", 15804u, 51743u }, // error 6.4e-10
+	{ "m4.00  ", 11752u, 33667u }, // error 1.2e-09
+};
+
+const uint8_t pitch_table_length = sizeof(pitch_table) / sizeof(pitch_table[0]);
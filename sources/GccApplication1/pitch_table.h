@@ -0,0 +1,18 @@
+#ifndef PITCH_TABLE_H_
+#define PITCH_TABLE_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/* Standard thread pitch as support motor steps per spindle encoder step (4x quadrature),
+ * numerator / denominator in lowest terms. Generated by tools/pitch_table.py. */
+typedef struct {
+	char name[8]; // 7 characters for the display
+	uint16_t numerator;
+	uint16_t denominator;
+} pitch_t;
+
+extern const pitch_t pitch_table[] PROGMEM;
+extern const uint8_t pitch_table_length;
+
+#endif /* PITCH_TABLE_H_ */
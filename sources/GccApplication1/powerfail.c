@@ -0,0 +1,113 @@
+#include "powerfail.h"
+
+#if POWERFAIL
+#include "cpu.h"
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "main.h"
+#include "buttons.h"
+#include "hal.h"
+#include "lcd.h"
+#include "support.h"
+#include "spindle.h"
+
+/******* power-loss snapshot ******/
+/* When the supply falls, ANALOG_COMP_vect writes the spindle, end and support positions and a
+ * CRC into EEPROM bytes erased at power-up: 13 writes of 1.8 ms, about 24 ms of hold-up time.
+ * A torn snapshot fails the CRC and is not offered. */
+typedef struct {
+	powerfail_snapshot_t positions;
+	uint8_t crc;
+} powerfail_record_t;
+
+static powerfail_record_t powerfail_record EEMEM;
+
+static uint8_t powerfail_crc(const powerfail_snapshot_t *snapshot) {
+	const uint8_t *bytes = (const uint8_t *)snapshot;
+	uint8_t crc = 0u;
+	for (uint8_t i = 0; i < sizeof(powerfail_snapshot_t); i++) {
+		crc = _crc8_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+void powerfail_init() {
+	hal_power_sense_init();
+}
+
+/* returns 0 when there is no complete snapshot */
+uint8_t powerfail_load(powerfail_snapshot_t *snapshot) {
+	powerfail_record_t record;
+	eeprom_read_block(&record, &powerfail_record, sizeof(record));
+	*snapshot = record.positions;
+	return record.crc == powerfail_crc(&record.positions);
+}
+
+/* The support stands where the power loss stopped it. The operator turns the spindle by hand until
+ * the tool sits in the cut groove, which is the stored spindle angle, and confirms with button 1. */
+uint8_t powerfail_ask_resume(const powerfail_snapshot_t *snapshot) {
+	lcd_clear();
+	lcd_set_cursor(0, 0);
+	lcd_puts("vypadek napajeni");
+	lcd_set_cursor(0, 1);
+	lcd_puts("support: ");
+	lcd_put_unsigned(snapshot->support_position, 11, ' ');
+	lcd_set_cursor(0, 2);
+	lcd_puts("nuz do drazky, tl. 1");
+	lcd_set_cursor(0, 3);
+	lcd_puts("zahodit tl. 2");
+	lcd_flush();
+
+	uint8_t resume;
+	button_clear_events();
+	while (1) {
+		uint8_t event = button_wait_event();
+		if (event == BUTTON_EVENT(BUTTON_1, BUTTON_PRESSED)) {
+			resume = 1;
+			break;
+		} else if (event == BUTTON_EVENT(BUTTON_2, BUTTON_PRESSED)) {
+			resume = 0;
+			break;
+		}
+	}
+	return resume;
+}
+
+/* erases the snapshot and enables the power-fail interrupt */
+void powerfail_arm() {
+	while (hal_power_is_failing())
+		; // still powering up
+
+	uint16_t address = (uint16_t)(uintptr_t)&powerfail_record;
+	for (uint8_t i = 0; i < sizeof(powerfail_record_t); i++) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			hal_eeprom_erase_byte(address + i);
+		}
+	}
+	hal_eeprom_wait();
+	hal_power_irq_enable();
+}
+
+ISR(ANALOG_COMP_vect) {
+	powerfail_record_t record;
+	record.positions.spindle_steps = get_current_spindle_revolution_steps();
+	record.positions.end_position = get_end_position();
+	record.positions.support_position = get_actual_support_position();
+	record.crc = powerfail_crc(&record.positions);
+
+	hal_driver_disable(); // leaves more of the hold-up energy to the EEPROM
+
+	uint16_t address = (uint16_t)(uintptr_t)&powerfail_record;
+	const uint8_t *bytes = (const uint8_t *)&record;
+	for (uint8_t i = 0; i < sizeof(record); i++) {
+		hal_eeprom_write_erased_byte(address + i, bytes[i]); // the CRC goes last
+	}
+	hal_eeprom_wait();
+
+	while (hal_power_is_failing())
+		; // until the supply dies or comes back
+	hal_reset(); // a dip that did not reset the CPU, start again with the resume question
+}
+#endif
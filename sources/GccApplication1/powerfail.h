@@ -0,0 +1,25 @@
+#ifndef POWERFAIL_H_
+#define POWERFAIL_H_
+
+#include <stdint.h>
+#include "main.h"
+
+typedef struct {
+	uint32_t spindle_steps;
+	uint32_t end_position;
+	uint32_t support_position;
+} powerfail_snapshot_t;
+
+#if POWERFAIL
+void powerfail_init();
+uint8_t powerfail_load(powerfail_snapshot_t *snapshot);
+uint8_t powerfail_ask_resume(const powerfail_snapshot_t *snapshot);
+void powerfail_arm();
+#else
+static inline void powerfail_init() {} // PC1 keeps its pull-up
+static inline uint8_t powerfail_load(powerfail_snapshot_t *snapshot) { (void)snapshot; return 0; }
+static inline uint8_t powerfail_ask_resume(const powerfail_snapshot_t *snapshot) { (void)snapshot; return 0; }
+static inline void powerfail_arm() {}
+#endif
+
+#endif /* POWERFAIL_H_ */
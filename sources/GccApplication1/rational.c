@@ -0,0 +1,75 @@
+#include "rational.h"
+
+uint32_t rational_gcd(uint32_t a, uint32_t b) {
+	while (b) {
+		uint32_t rest = a % b;
+		a = b;
+		b = rest;
+	}
+	return a;
+}
+
+/* |p / q - numerator / denominator| scaled by q * denominator */
+static uint64_t rational_distance(uint32_t p, uint32_t q, uint32_t numerator, uint32_t denominator) {
+	uint64_t left = (uint64_t)p * denominator;
+	uint64_t right = (uint64_t)q * numerator;
+	return (left > right) ? left - right : right - left;
+}
+
+/* Walks the convergents p/q of the continued fraction until the next one exceeds the limit, then
+ * takes the largest semiconvergent that still fits if it is closer. Every step costs one 32 bit
+ * division, 30 steps at most for 32 bit inputs. */
+rational_t rational_approximate(uint32_t numerator, uint32_t denominator, uint16_t limit) {
+	uint32_t p0 = 0, q0 = 1; // previous convergent
+	uint32_t p1 = 1, q1 = 0; // last convergent
+	uint32_t n = numerator;
+	uint32_t d = denominator;
+	rational_t result;
+
+	while (d) {
+		uint32_t a = n / d;
+		uint32_t rest = n % d;
+
+		if (((p1 != 0) && (a > (limit - p0) / p1)) || ((q1 != 0) && (a > (limit - q0) / q1))) {
+			// the next convergent does not fit, try the semiconvergent (p0 + k * p1) / (q0 + k * q1)
+			uint32_t k = (p1 != 0) ? (limit - p0) / p1 : a;
+			if ((q1 != 0) && ((limit - q0) / q1 < k)) {
+				k = (limit - q0) / q1;
+			}
+			uint32_t p = p0 + k * p1;
+			uint32_t q = q0 + k * q1;
+			if ((q1 == 0) || ((q != 0) && (rational_distance(p, q, numerator, denominator) * q1 < rational_distance(p1, q1, numerator, denominator) * q))) {
+				p1 = p;
+				q1 = q;
+			}
+			break;
+		}
+
+		uint32_t p2 = p0 + a * p1;
+		uint32_t q2 = q0 + a * q1;
+		p0 = p1;
+		q0 = q1;
+		p1 = p2;
+		q1 = q2;
+		n = d;
+		d = rest;
+	}
+
+	result.numerator = p1;
+	result.denominator = q1;
+	return result;
+}
+
+uint32_t rational_error(rational_t approximation, uint32_t numerator, uint32_t denominator, uint32_t scale) {
+	uint64_t distance = rational_distance(approximation.numerator, approximation.denominator, numerator, denominator);
+	uint64_t reference = (uint64_t)approximation.denominator * numerator;
+
+	if (reference == 0) {
+		return UINT32_MAX;
+	}
+	if (distance > UINT64_MAX / scale) {
+		return UINT32_MAX;
+	}
+	uint64_t error = distance * scale / reference;
+	return (error > UINT32_MAX) ? UINT32_MAX : error;
+}
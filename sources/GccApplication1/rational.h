@@ -0,0 +1,24 @@
+#ifndef RATIONAL_H_
+#define RATIONAL_H_
+
+#include <stdint.h>
+
+/*
+ * Best rational approximation by continued fractions. Plain C without AVR headers, so it can be
+ * compiled and checked on a PC as well.
+ */
+
+typedef struct {
+	uint16_t numerator;
+	uint16_t denominator;
+} rational_t;
+
+uint32_t rational_gcd(uint32_t a, uint32_t b);
+
+/* the fraction closest to numerator / denominator with both terms <= limit */
+rational_t rational_approximate(uint32_t numerator, uint32_t denominator, uint16_t limit);
+
+/* |approximation / (numerator / denominator) - 1| * scale, saturated to UINT32_MAX */
+uint32_t rational_error(rational_t approximation, uint32_t numerator, uint32_t denominator, uint32_t scale);
+
+#endif /* RATIONAL_H_ */
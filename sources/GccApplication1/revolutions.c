@@ -1,40 +1,112 @@
 #include "revolutions.h"
-#include <avr/interrupt.h>
-#include <avr/io.h>
 #include "led.h"
 #include "main.h"
+#include "hal.h"
+#include "support.h"
+#include "diagnostics.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "buttons.h"
+
+/********* revolutions per minute calculation **************/
+/* The encoder interrupt timestamps its steps with Timer1 (2 MHz, extended to 32 bits by
+ * its overflow interrupt) and measures the period of every RPM_WINDOW_STEPS steps, so the
+ * speed is refreshed eight times per turn with 0.5 us resolution. */
+#define RPM_WINDOW_STEPS (SPINDLE_STEPS_FOR_ONE_TURN / 8u)
+#define RPM_TIMEOUT_TICKS (2ul * HAL_STEP_TIMER_HZ) // slower than this is shown as stopped
+
+static uint16_t step_timer_overflows = 0;
+
+static uint32_t window_start = 0; // timestamp of the first step of the window
+static uint16_t window_steps = 0;
+static uint8_t window_rotate_left = 2; // no step yet
+static uint32_t window_period = 0; // ticks of the last complete window, 0 = not measured yet
 
-/********* revolutions per second calculation **************/
-static /*volatile*/ int16_t spindle_revolutions_per_minute = 0;
-static uint16_t previous_spindle_revolutions = 0;
 static uint16_t x_ms_to_one_second = 0;
 
-int16_t get_revolutions_per_minute() {
-	return spindle_revolutions_per_minute;
+/* call with interrupts disabled */
+uint32_t step_timer_timestamp() {
+	uint16_t low = hal_step_timer_now();
+	uint16_t high = step_timer_overflows;
+	if (hal_step_timer_overflow_is_pending() && (low < 0x8000u)) {
+		high++; // overflowed after entering the interrupt
+	}
+	return ((uint32_t)high << 16) | low;
 }
 
-void init_revolution_calculation(void) {
-	OCR0A = 125u; // 16 MHz / 256 / 125 = 2 ms
-	TCCR0A = 1 << WGM01; // Clear Timer on Compare Match (CTC) Mode
-	TCCR0B = 1 << CS02; // CLK / 256x
-	TIMSK0 = 1 << OCIE0A; // enable interrupt
+HAL_ISR(TIMER1_OVF_vect) {
+	step_timer_overflows++;
 }
 
-/* call this method once per second */
-static void recalculate_revolutions_per_second() {
-	uint16_t tmp = get_spindle_revolution_steps_overflow();
-	int16_t angle_increment_per_second = tmp - previous_spindle_revolutions;
-	previous_spindle_revolutions = tmp;
-	
-	int32_t angle_increment_per_minute = 60l * angle_increment_per_second;
-	spindle_revolutions_per_minute = angle_increment_per_minute / STEPS_FOR_ONE_TURN;
+/* called from the encoder interrupt for every spindle step */
+void revolutions_count_step(uint8_t rotate_left) {
+	uint32_t now = step_timer_timestamp();
+	telemetry_edge(now, rotate_left);
+
+	if (rotate_left != window_rotate_left) { // direction changed, start again
+		window_rotate_left = rotate_left;
+		window_steps = 0;
+		window_period = 0;
+		window_start = now;
+	} else if (++window_steps == RPM_WINDOW_STEPS) {
+		window_steps = 0;
+		window_period = now - window_start;
+		window_start = now;
+	}
 }
 
-ISR(TIMER0_COMPA_vect) { // once per 2ms
+int32_t get_spindle_steps_per_second() {
+	uint32_t period;
+	uint32_t elapsed;
+	uint16_t steps;
+	uint8_t rotate_left;
+
+	HAL_ATOMIC_BLOCK() {
+		period = window_period;
+		elapsed = step_timer_timestamp() - window_start;
+		steps = window_steps;
+		rotate_left = window_rotate_left;
+	}
+
+	if (elapsed > RPM_TIMEOUT_TICKS) {
+		return 0;
+	}
+	if (elapsed > period) { // slowing down, the running window is already longer than the last one
+		if (steps == 0) {
+			return 0;
+		}
+		period = elapsed;
+	} else {
+		steps = RPM_WINDOW_STEPS;
+	}
+	if (period == 0) {
+		return 0; // read in the same timer tick as a direction change
+	}
+
+	int32_t steps_per_second = HAL_STEP_TIMER_HZ * steps / period;
+	return rotate_left ? steps_per_second : -steps_per_second;
+}
+
+int16_t get_revolutions_per_minute() {
+	return get_spindle_steps_per_second() * 60 / (int16_t)SPINDLE_STEPS_FOR_ONE_TURN;
+}
+
+void init_revolution_calculation(void) {
+	hal_step_timer_overflow_irq_enable();
+	hal_tick_timer_init();
+}
+
+HAL_ISR(TIMER0_COMPA_vect) { // once per 2ms
+	hal_probe_tick_begin();
+	support_sample_following_error();
+	support_update_prediction();
+	telemetry_sample();
+	buttons_scan();
+	scheduler_tick();
 	if (x_ms_to_one_second++ == 500u) {
 		x_ms_to_one_second = 0; // once per second
-		recalculate_revolutions_per_second();
-
 		led_toggle();
+		diagnostics_second();
 	}
-}
\ No newline at end of file
+	hal_probe_tick_end();
+}
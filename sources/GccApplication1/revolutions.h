@@ -7,5 +7,8 @@
 void init_revolution_calculation();
 
 int16_t get_revolutions_per_minute();
+int32_t get_spindle_steps_per_second();
+void revolutions_count_step(uint8_t rotate_left);
+uint32_t step_timer_timestamp();
 
 #endif /* REVOLUTIONS_H_ */
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "scheduler.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+static volatile uint8_t scheduler_ticks = 0u; // elapsed since the last run
+
+/* called from the tick interrupt */
+void scheduler_tick() {
+	if (scheduler_ticks < UINT8_MAX) {
+		scheduler_ticks++;
+	}
+}
+
+/* sleeps until a tick elapses; the other interrupts wake the CPU and are served as before */
+static uint8_t scheduler_wait() {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while (1) {
+		cli();
+		uint8_t elapsed = scheduler_ticks;
+		if (elapsed) {
+			scheduler_ticks = 0u;
+			sei();
+			return elapsed;
+		}
+		sleep_enable();
+		sei(); // the instruction after sei is executed before any interrupt, the tick cannot be missed
+		sleep_cpu();
+		sleep_disable();
+	}
+}
+
+/* call from the main loop */
+void scheduler_run(scheduler_task_t *tasks, uint8_t count) {
+	uint8_t elapsed = scheduler_wait();
+
+	for (uint8_t i = 0; i < count; i++) {
+		if (tasks[i].countdown > elapsed) {
+			tasks[i].countdown -= elapsed;
+		} else {
+			tasks[i].countdown = tasks[i].period;
+			tasks[i].run();
+		}
+	}
+}
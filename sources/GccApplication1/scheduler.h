@@ -0,0 +1,20 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+/*
+ * Cooperative main loop: the 2 ms tick interrupt counts ticks, scheduler_run() sleeps in idle
+ * mode until the next tick and then runs every task whose period has elapsed. A task that runs
+ * longer than a tick delays the others once; the missed ticks are not run again.
+ */
+typedef struct {
+	void (*run)();
+	uint8_t period; // ticks of 2 ms
+	uint8_t countdown; // ticks to the next run, 0 = at the first tick
+} scheduler_task_t;
+
+void scheduler_tick();
+void scheduler_run(scheduler_task_t *tasks, uint8_t count);
+
+#endif /* SCHEDULER_H_ */
@@ -1,16 +1,77 @@
 #include "setup_menu.h"
 #include "cpu.h"
-#include <util/delay.h>
 #include <avr/io.h>
+#include <util/delay.h>
+#include <string.h>
 #include "buttons.h"
+#include "config_store.h"
 #include "lcd.h"
+#include "main.h"
+#include "pitch_table.h"
+#include "rational.h"
 
 static uint8_t step_multiplier = 1u;
 static uint8_t step_divisor = 1u;
 static mode_t mode = LEFT;
+static uint8_t prediction = 0u;
+static uint8_t passes = 0u; // automatic threading cycle, 0 = off
+static uint8_t depth = 0u; // thread depth in hundredths of mm
+static uint8_t pitch = 0u; // 0 = step_multiplier / step_divisor, PITCH_CUSTOM = custom_pitch, else pitch_table[pitch - 1]
+static uint8_t custom_pitch_tpi = 0u; // custom_pitch in 0 = thousandths of mm, 1 = tenths of TPI
+static uint16_t custom_pitch = 1000u;
+static rational_t custom_ratio; // custom_pitch in support steps per spindle step
+static uint32_t custom_error; // of custom_ratio, nm per 100 mm of thread
+
+#define PITCH_CUSTOM (pitch_table_length + 1u)
+
+static const char custom_pitch_name[] PROGMEM = "zadane ";
 
-float get_configured_fraction() {
-	return (float)step_multiplier / step_divisor;
+/* the exact ratio of custom_pitch reduced to lowest terms, then the closest one the gearing can use */
+static void custom_pitch_solve() {
+	uint32_t numerator;
+	uint64_t denominator;
+
+	if (custom_pitch_tpi) { // pitch = 25.4 mm / (custom_pitch / 10)
+		numerator = 254000ul * SUPPORT_STEPS_PER_LEADSCREW_TURN;
+		denominator = (uint64_t)custom_pitch * LEADSCREW_PITCH_UM * SPINDLE_STEPS_FOR_ONE_TURN;
+	} else {
+		numerator = (uint32_t)custom_pitch * SUPPORT_STEPS_PER_LEADSCREW_TURN;
+		denominator = (uint64_t)LEADSCREW_PITCH_UM * SPINDLE_STEPS_FOR_ONE_TURN;
+	}
+
+	uint32_t divisor = rational_gcd(numerator, denominator % numerator);
+	numerator /= divisor;
+	denominator /= divisor;
+	while (denominator > UINT32_MAX) { // only with a very fine leadscrew drive, the result is approximated anyway
+		numerator >>= 1;
+		denominator >>= 1;
+	}
+
+	custom_ratio = rational_approximate(numerator, denominator, UINT16_MAX);
+	custom_error = rational_error(custom_ratio, numerator, denominator, 100000000ul); // 100 mm in nm
+}
+
+/* support steps per spindle encoder step (4x quadrature) */
+uint16_t get_configured_numerator() {
+	if (pitch == PITCH_CUSTOM) {
+		return custom_ratio.numerator;
+	}
+	return pitch ? pgm_read_word(&pitch_table[pitch - 1].numerator) : step_multiplier;
+}
+
+uint16_t get_configured_denominator() {
+	if (pitch == PITCH_CUSTOM) {
+		return custom_ratio.denominator;
+	}
+	return pitch ? pgm_read_word(&pitch_table[pitch - 1].denominator) : 4u * step_divisor; // the ratio is set per encoder line
+}
+
+/* in flash, 0 when the ratio is set by the multiplier and divisor */
+const char *get_configured_pitch_name() {
+	if (pitch == PITCH_CUSTOM) {
+		return custom_pitch_name;
+	}
+	return pitch ? pitch_table[pitch - 1].name : 0;
 }
 
 mode_t get_configured_mode() {
@@ -25,13 +86,42 @@ uint8_t get_configured_divisor() {
 	return step_divisor;
 }
 
+uint8_t get_configured_prediction() {
+	return prediction;
+}
+
+uint8_t get_configured_passes() {
+	return passes;
+}
+
+uint8_t get_configured_depth() {
+	return depth;
+}
+
 static void display_user_setting_values() {
 	lcd_set_cursor(0, 0);
 	lcd_enable_cursor();
 	lcd_enable_blinking();
-	lcd_printf("%-5s %03u/%03u", (mode == LEFT) ? "Levy" : "Pravy", step_multiplier, step_divisor);
+	lcd_puts((mode == LEFT) ? "Levy  " : "Pravy ");
+	lcd_put_unsigned(step_multiplier, 3, '0');
+	lcd_put_char('/');
+	lcd_put_unsigned(step_divisor, 3, '0');
+	lcd_set_cursor(0, 1);
+	lcd_puts("predstih: ");
+	lcd_puts(prediction ? "ano" : "ne ");
 	lcd_set_cursor(0, 2);
-	lcd_printf("%03u/%03u = %f", step_multiplier, step_divisor, get_configured_fraction());
+	lcd_puts("stoupani: ");
+	if (pitch) {
+		lcd_puts_P(get_configured_pitch_name());
+	} else {
+		lcd_puts("vlastni");
+	}
+	lcd_set_cursor(0, 3);
+	lcd_puts("pruchody ");
+	lcd_put_unsigned(passes, 2, '0');
+	lcd_puts(" h ");
+	lcd_put_fixed(depth, 2, 4);
+	lcd_puts("mm");
 }
 
 /************* user setup values / menu **************/
@@ -47,6 +137,117 @@ static uint8_t user_add_witout_overflow(uint8_t orig, int8_t increment) {
 	}
 }
 
+static uint16_t user_add_witout_overflow_16(uint16_t orig, int32_t increment) {
+	int32_t res = orig;
+	res += increment;
+	if (res > UINT16_MAX) {
+		return UINT16_MAX;
+	} else if (res < 1) {
+		return 1; // a pitch of 0 has no ratio
+	} else {
+		return res;
+	}
+}
+
+/************* custom pitch **************/
+static void display_custom_pitch() {
+	lcd_set_cursor(0, 0);
+	lcd_puts("zadane stoupani");
+	lcd_set_cursor(0, 1);
+	if (custom_pitch_tpi) {
+		lcd_puts("TPI ");
+		lcd_put_unsigned(custom_pitch / 10u, 4, '0');
+		lcd_put_char('.');
+		lcd_put_unsigned(custom_pitch % 10u, 1, '0');
+	} else {
+		lcd_puts("mm  ");
+		lcd_put_unsigned(custom_pitch / 1000u, 2, '0');
+		lcd_put_char('.');
+		lcd_put_unsigned(custom_pitch % 1000u, 3, '0');
+	}
+	lcd_set_cursor(0, 2);
+	lcd_puts("pomer ");
+	lcd_put_unsigned(custom_ratio.numerator, 5, ' ');
+	lcd_put_char('/');
+	lcd_put_unsigned(custom_ratio.denominator, -5, ' ');
+	lcd_set_cursor(0, 3);
+	lcd_puts("chyba ");
+	lcd_put_fixed((custom_error > 99999ul) ? 99999ul : custom_error, 3, 6);
+	lcd_puts("um/100mm");
+}
+
+/* the unit at 20, the digits from 24 on: mm = 12.345, TPI = 1234.5 */
+static uint8_t custom_pitch_next_position(uint8_t prev) {
+	switch (prev) {
+		case 20: return 24;
+		case 24: return 25;
+		case 25: return custom_pitch_tpi ? 26 : 27;
+		case 26: return 27;
+		case 27: return custom_pitch_tpi ? 29 : 28;
+		case 28: return 29;
+		default: return UINT8_MAX;
+	}
+}
+
+static uint16_t custom_pitch_digit_weight(uint8_t position) {
+	switch (position) {
+		case 24: return 10000u;
+		case 25: return 1000u;
+		case 26: return 100u;
+		case 27: return custom_pitch_tpi ? 10u : 100u;
+		case 28: return 10u;
+		case 29: return 1u;
+		default: return 0u;
+	}
+}
+
+/* waits for a push; buttons 2 and 3 repeat while held, button 1 moves on once per push */
+static uint8_t user_wait_button() {
+	while (1) {
+		uint8_t event = button_wait_event();
+		uint8_t button = BUTTON_EVENT_BUTTON(event);
+		uint8_t type = BUTTON_EVENT_TYPE(event);
+		if ((type == BUTTON_PRESSED) || ((type == BUTTON_REPEAT) && (button != BUTTON_1))) {
+			return button;
+		}
+	}
+}
+
+static void user_setup_custom_pitch() {
+	uint8_t position = 20;
+
+	lcd_clear();
+	button_clear_events();
+
+	while(position != UINT8_MAX) {
+		display_custom_pitch();
+		lcd_set_cursor(position % LCD_COL_COUNT, position / LCD_COL_COUNT); // position = row * LCD_COL_COUNT + column
+		lcd_flush();
+
+		uint8_t button = user_wait_button();
+		if (button == BUTTON_1) {
+			position = custom_pitch_next_position(position);
+		} else if (position == 20) {
+			if (button == BUTTON_2 || button == BUTTON_3) {
+				custom_pitch_tpi = !custom_pitch_tpi;
+				custom_pitch_solve();
+			}
+		} else {
+			uint16_t weight = custom_pitch_digit_weight(position);
+			if (button == BUTTON_2) {
+				custom_pitch = user_add_witout_overflow_16(custom_pitch, weight);
+				custom_pitch_solve();
+			} else if (button == BUTTON_3) {
+				custom_pitch = user_add_witout_overflow_16(custom_pitch, -(int32_t)weight);
+				custom_pitch_solve();
+			}
+		}
+
+	}
+	lcd_clear();
+}
+
+/************* menu **************/
 static uint8_t user_setup_next_position(uint8_t prev) {
 	switch (prev) {
 		case 0: return 6;
@@ -55,23 +256,36 @@ static uint8_t user_setup_next_position(uint8_t prev) {
 		case 8: return 10;
 		case 10: return 11;
 		case 11: return 12;
-		case 12: return UINT8_MAX;
+		case 12: return 30;
+		case 30: return 50;
+		case 50: return 69;
+		case 69: return 70;
+		case 70: return 74;
+		case 74: return 76;
+		case 76: return 77;
+		case 77: return UINT8_MAX;
 		default: return UINT8_MAX;
 	}
 }
 
 void user_setup_values() {
 	uint8_t position = 0;
+	button_clear_events();
 	while(position != UINT8_MAX) {
 		display_user_setting_values();
-		lcd_set_cursor(position, 0);	
+		lcd_set_cursor(position % LCD_COL_COUNT, position / LCD_COL_COUNT); // position = row * LCD_COL_COUNT + column
+		lcd_flush();
 		
-		if (button_1_is_pressed()) {
+		uint8_t button = user_wait_button();
+		if (button == BUTTON_1) {
+			if ((position == 50) && (pitch == PITCH_CUSTOM)) {
+				user_setup_custom_pitch();
+			}
 			position = user_setup_next_position(position);
 		} else {
 			switch(position) {
 				case 0:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						if (mode == LEFT) {
 							mode = RIGHT;
 						} else if (mode == RIGHT) {
@@ -80,47 +294,94 @@ void user_setup_values() {
 					}
 					break;
 				case 6:	
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, 100);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, -100);
 					}
 					break;
 				case 7:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, 10);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, -10);
 					}
 					break;
 				case 8:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, 1);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_multiplier = user_add_witout_overflow(step_multiplier, -1);
 					}
 						break;
 				case 10:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_divisor = user_add_witout_overflow(step_divisor, 100);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_divisor = user_add_witout_overflow(step_divisor, -100);
 					}
 					break;
 				case 11:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_divisor = user_add_witout_overflow(step_divisor, 10);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_divisor = user_add_witout_overflow(step_divisor, -10);
 					}
 					break;
 				case 12:
-					if (button_2_is_pressed()) {
+					if (button == BUTTON_2) {
 						step_divisor = user_add_witout_overflow(step_divisor, 1);
-					} else if (button_3_is_pressed()) {
+					} else if (button == BUTTON_3) {
 						step_divisor = user_add_witout_overflow(step_divisor, -1);
 					}
 					break;
+				case 30:
+					if (button == BUTTON_2 || button == BUTTON_3) {
+						prediction = !prediction;
+					}
+					break;
+				case 50:
+					if (button == BUTTON_2) {
+						pitch = (pitch < PITCH_CUSTOM) ? pitch + 1 : 0;
+					} else if (button == BUTTON_3) {
+						pitch = pitch ? pitch - 1u : PITCH_CUSTOM;
+					}
+					break;
+				case 69:
+					if (button == BUTTON_2) {
+						passes = user_add_witout_overflow(passes, 10);
+					} else if (button == BUTTON_3) {
+						passes = user_add_witout_overflow(passes, -10);
+					}
+					break;
+				case 70:
+					if (button == BUTTON_2) {
+						passes = user_add_witout_overflow(passes, 1);
+					} else if (button == BUTTON_3) {
+						passes = user_add_witout_overflow(passes, -1);
+					}
+					break;
+				case 74:
+					if (button == BUTTON_2) {
+						depth = user_add_witout_overflow(depth, 100);
+					} else if (button == BUTTON_3) {
+						depth = user_add_witout_overflow(depth, -100);
+					}
+					break;
+				case 76:
+					if (button == BUTTON_2) {
+						depth = user_add_witout_overflow(depth, 10);
+					} else if (button == BUTTON_3) {
+						depth = user_add_witout_overflow(depth, -10);
+					}
+					break;
+				case 77:
+					if (button == BUTTON_2) {
+						depth = user_add_witout_overflow(depth, 1);
+					} else if (button == BUTTON_3) {
+						depth = user_add_witout_overflow(depth, -1);
+					}
+					break;
 				default:
 					break;
 			}	
@@ -129,9 +390,87 @@ void user_setup_values() {
 		if (step_divisor == 0) {
 			step_divisor = 1;	
 		}
+		if (passes > 99) {
+			passes = 99;
+		}
+	}
+}
+
+/************* persistent settings **************/
+#define SETUP_VERSION 3u // change together with setup_values_t
+
+typedef struct {
+	uint8_t mode;
+	uint8_t step_multiplier;
+	uint8_t step_divisor;
+	uint8_t prediction;
+	uint8_t passes;
+	uint8_t depth;
+	uint8_t pitch;
+	uint8_t custom_pitch_tpi;
+	uint16_t custom_pitch;
+} setup_values_t;
+
+static void setup_pack(setup_values_t *values) {
+	values->mode = mode;
+	values->step_multiplier = step_multiplier;
+	values->step_divisor = step_divisor;
+	values->prediction = prediction;
+	values->passes = passes;
+	values->depth = depth;
+	values->pitch = pitch;
+	values->custom_pitch_tpi = custom_pitch_tpi;
+	values->custom_pitch = custom_pitch;
+}
+
+static void setup_unpack(const setup_values_t *values) {
+	mode = (values->mode == RIGHT) ? RIGHT : LEFT;
+	step_multiplier = values->step_multiplier;
+	step_divisor = values->step_divisor ? values->step_divisor : 1u;
+	prediction = values->prediction ? 1u : 0u;
+	passes = (values->passes > 99) ? 99 : values->passes;
+	depth = values->depth;
+	pitch = (values->pitch > PITCH_CUSTOM) ? 0 : values->pitch;
+	custom_pitch_tpi = values->custom_pitch_tpi ? 1u : 0u;
+	custom_pitch = values->custom_pitch ? values->custom_pitch : 1u;
+}
+
+#define SETUP_HINT_MS 1000u // how long the power-up hint waits for button 1
+
+/* shows the power-up hint, 1 = button 1 was pressed within SETUP_HINT_MS */
+static uint8_t user_setup_is_requested() {
+	lcd_clear();
+	lcd_puts("nastaveni: tl. 1");
+	lcd_flush();
+	for (uint16_t ms = 0u; ms < SETUP_HINT_MS; ms += 10u) {
+		if (button_1_is_pressed()) {
+			return 1;
+		}
+		_delay_ms(10);
+	}
+	return 0;
+}
+
+/* starts with the last saved configuration; the menu opens only without one or when button 1 is
+ * pressed while the power-up hint is shown. Returns 1 when the menu was opened. */
+uint8_t user_setup() {
+	setup_values_t stored;
+	setup_values_t values;
+	uint8_t loaded = config_store_load(&stored, sizeof(stored), SETUP_VERSION);
+
+	if (loaded) {
+		setup_unpack(&stored);
+	}
+	custom_pitch_solve();
+	if (loaded && !user_setup_is_requested()) {
+		return 0;
+	}
+
+	user_setup_values();
 
-		while(button_status())
-			;
-		_delay_ms(100);
+	setup_pack(&values);
+	if (!loaded || memcmp(&values, &stored, sizeof(values))) {
+		config_store_save(&values, sizeof(values), SETUP_VERSION);
 	}
+	return 1;
 }
@@ -9,10 +9,16 @@ typedef enum {
 } mode_t;
 
 void user_setup_values();
+uint8_t user_setup();
 
-float get_configured_fraction();
+uint16_t get_configured_numerator();
+uint16_t get_configured_denominator();
+const char *get_configured_pitch_name();
 mode_t get_configured_mode();
 uint8_t get_configured_multiplier();
 uint8_t get_configured_divisor();
+uint8_t get_configured_prediction();
+uint8_t get_configured_passes();
+uint8_t get_configured_depth();
 
 #endif /* SETUP_MENU_H_ */
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "spindle.h"
+#include "main.h"
+#include "hal.h"
+#include "support.h"
+#include "revolutions.h"
+#include "diagnostics.h"
+
+/******* Angle and position ******/
+/* The spindle position is kept as whole turns and the angle within the turn,
+ * position = revolutions * SPINDLE_STEPS_FOR_ONE_TURN + angle, so the encoder interrupt updates
+ * it with 16 bit increments and compares and the display needs no division. */
+#define END_POSITION_INIT_VALUE (UINT32_MAX - SPINDLE_STEPS_FOR_ONE_TURN) 
+#define END_REVOLUTION_INIT_VALUE UINT16_MAX
+static uint16_t end_revolution = END_REVOLUTION_INIT_VALUE;
+static uint16_t end_angle = 0u;
+static /*volatile*/ uint32_t end_position = END_POSITION_INIT_VALUE; // the same as one number, for the support
+
+static uint16_t spindle_revolutions = 0u;
+static uint16_t spindle_angle = 0u; // 0 .. SPINDLE_STEPS_FOR_ONE_TURN - 1
+static uint8_t encoder_state;
+static uint16_t encoder_errors; //can overflow
+static uint8_t spindle_left = 1u; // 1 = the encoder counts up while the spindle turns left
+
+#define SPINDLE_HOLD_OFF 0u
+#define SPINDLE_HOLD_ON 1u // the spindle position loops in the first turn, the support waits at the start
+#define SPINDLE_HOLD_RELEASE 2u // leave the loop at the end of the current turn
+static volatile uint8_t spindle_hold = SPINDLE_HOLD_OFF;
+
+static uint32_t spindle_position(uint16_t revolutions, uint16_t angle) {
+	return (uint32_t)revolutions * SPINDLE_STEPS_FOR_ONE_TURN + angle;
+}
+
+uint32_t get_end_position() {
+	return end_position;
+}
+
+uint16_t get_encoder_errors() {
+	return encoder_errors;
+}
+
+/* call with interrupts disabled */
+uint32_t get_current_spindle_revolution_steps() {
+	return spindle_position(spindle_revolutions, spindle_angle);
+}
+
+/* the current position becomes the end of the thread, only the first time */
+void spindle_set_end_position() {
+	HAL_ATOMIC_BLOCK() {
+		if (end_revolution == END_REVOLUTION_INIT_VALUE) {
+			end_revolution = spindle_revolutions;
+			end_angle = spindle_angle;
+			end_position = spindle_position(end_revolution, end_angle);
+		}
+	}
+}
+
+void get_spindle_angle(uint16_t *revolutions, uint16_t *angle) {
+	HAL_ATOMIC_BLOCK() {
+		*revolutions = spindle_revolutions;
+		*angle = spindle_angle;
+	}
+}
+
+/* after a power loss, before the step counting starts */
+void spindle_restore(uint32_t spindle_steps, uint32_t end_steps) {
+	spindle_revolutions = spindle_steps / SPINDLE_STEPS_FOR_ONE_TURN;
+	spindle_angle = spindle_steps % SPINDLE_STEPS_FOR_ONE_TURN;
+	if (end_steps != END_POSITION_INIT_VALUE) {
+		end_revolution = end_steps / SPINDLE_STEPS_FOR_ONE_TURN;
+		end_angle = end_steps % SPINDLE_STEPS_FOR_ONE_TURN;
+		end_position = end_steps;
+	}
+}
+
+uint8_t spindle_is_past_end() {
+	uint8_t past_end;
+	HAL_ATOMIC_BLOCK() {
+		past_end = (end_revolution != END_REVOLUTION_INIT_VALUE)
+			&& ((spindle_revolutions > end_revolution) || ((spindle_revolutions == end_revolution) && (spindle_angle >= end_angle)));
+	}
+	return past_end;
+}
+
+/* moves the spindle position back into the first turn at the same angle and sends the support
+ * back to the start, where it waits until spindle_release() */
+void spindle_rewind() {
+	HAL_ATOMIC_BLOCK() {
+		spindle_revolutions = 0u;
+		spindle_hold = SPINDLE_HOLD_ON;
+		support_rewind();
+		support_schedule_step();
+	}
+}
+
+/* the next pass starts one turn after the end of the current one */
+void spindle_release() {
+	HAL_ATOMIC_BLOCK() {
+		if (spindle_hold == SPINDLE_HOLD_ON) {
+			spindle_hold = SPINDLE_HOLD_RELEASE;
+		}
+	}
+}
+
+static void schedule_support_position_recalculation() {
+	support_schedule_step();
+}
+
+static void spindle_position_recalculation(uint8_t rotate_left) {
+	if (rotate_left) { // rotating left or right?
+		if (++spindle_angle == SPINDLE_STEPS_FOR_ONE_TURN) {
+			spindle_angle = 0u;
+			spindle_revolutions++;
+		}
+		if ((spindle_angle == end_angle) && (spindle_revolutions == end_revolution + 1u)) {
+			spindle_revolutions--; // loop in the turn after the end position
+		} else if (spindle_hold && (spindle_angle == 0u) && (spindle_revolutions == 1u)) {
+			spindle_revolutions = 0u; // loop in the first turn
+			if (spindle_hold == SPINDLE_HOLD_RELEASE) {
+				spindle_hold = SPINDLE_HOLD_OFF;
+				support_release(); // at position 0 the lead ahead of the spindle stays within the first turn
+			}
+		}
+	} else {
+		if (spindle_angle-- == 0u) {
+			spindle_angle = SPINDLE_STEPS_FOR_ONE_TURN - 1u;
+			if (spindle_revolutions != 0u) {
+				spindle_revolutions--;
+			} // else loop in the first turn
+		}
+	}
+	
+	recalculate_support_position(spindle_position(spindle_revolutions, spindle_angle));
+	schedule_support_position_recalculation();
+	revolutions_count_step(rotate_left);
+}
+
+/* Quadrature decoding, index = previous state << 2 | new state, state = yellow << 1 | green.
+ * Yellow rising while green is high counts +1, like the former rising edge INT0 decoding. */
+#define ENCODER_INVALID 2
+static const int8_t encoder_transitions[16] = {
+	 0,  1, -1, ENCODER_INVALID,
+	-1,  0, ENCODER_INVALID,  1,
+	 1, ENCODER_INVALID,  0, -1,
+	ENCODER_INVALID, -1,  1,  0
+};
+
+static void encoder_decode() {
+	uint8_t state = hal_encoder_state();
+	int8_t transition = encoder_transitions[(encoder_state << 2) | state];
+	encoder_state = state;
+
+	if (transition == ENCODER_INVALID) {
+		encoder_errors++; // both wires changed at once, the step is lost
+	} else if (transition != 0) {
+		spindle_position_recalculation((transition > 0) == spindle_left);
+	}
+}
+	
+//Rotary Encoder interrupts
+HAL_ISR(INT0_vect) { //Interrupt Vectors in ATmega328P - page 48
+	hal_probe_encoder_begin();
+	uint16_t begin = diagnostics_time_begin();
+	encoder_decode();
+	diagnostics_encoder_isr_end(begin);
+	hal_probe_encoder_end();
+}
+
+HAL_ISR(PCINT0_vect) {
+	hal_probe_encoder_begin();
+	uint16_t begin = diagnostics_time_begin();
+	encoder_decode();
+	diagnostics_encoder_isr_end(begin);
+	hal_probe_encoder_end();
+}
+
+/* left = 1 for the LEFT mode of the setup menu */
+void init_step_counting(uint8_t left) {
+	spindle_left = left ? 1u : 0u;
+	hal_encoder_init();
+	encoder_state = hal_encoder_state();
+}
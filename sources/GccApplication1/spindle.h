@@ -0,0 +1,24 @@
+#ifndef SPINDLE_H_
+#define SPINDLE_H_
+
+#include <stdint.h>
+
+/*
+ * Spindle position from the quadrature encoder (INT0 and PCINT0), the end of the thread and the
+ * loops in the first turn and after the end. Every spindle step moves the support, see support.c.
+ */
+
+void init_step_counting(uint8_t left);
+void spindle_restore(uint32_t spindle_steps, uint32_t end_steps);
+void spindle_set_end_position();
+
+uint32_t get_end_position();
+uint32_t get_current_spindle_revolution_steps();
+void get_spindle_angle(uint16_t *revolutions, uint16_t *angle);
+uint16_t get_encoder_errors();
+
+uint8_t spindle_is_past_end();
+void spindle_rewind();
+void spindle_release();
+
+#endif /* SPINDLE_H_ */
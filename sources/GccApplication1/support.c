@@ -1,16 +1,160 @@
 #include "support.h"
-#include <avr/interrupt.h>
-#include <avr/io.h>
-#include <util/atomic.h>
 #include "main.h"
+#include "hal.h"
+#include "spindle.h"
+#include "diagnostics.h"
+
+/* The step interrupt comes SUPPORT_STEP_LEAD_TICKS before the step is due and arms the Timer2
+ * one shot, which raises the pulse at the due tick itself. The latency of the interrupt, up to
+ * the lead, does not move the step; the next due time is planned by the interrupt before. */
+#define SUPPORT_STEP_LEAD_TICKS 48u // 24 us, longer than the encoder interrupt
+#define SUPPORT_WAKE_UP_TICKS 16u // first step 8 + 24 us after the encoder edge
+
+#if HAL_STEP_TIMER_HZ / SUPPORT_MAX_STEPS_PER_SECOND < SUPPORT_STEP_LEAD_TICKS + HAL_PULSE_WIDTH_TICKS
+#error "SUPPORT_MAX_STEPS_PER_SECOND is faster than the Timer2 one shot pulse can repeat"
+#endif
+
+/******* step command queue *********/
+/* Single producer (encoder interrupt) / single consumer (step interrupt) ring buffer.
+ * Each side writes only its own index, so neither needs to disable interrupts. */
+#define STEP_QUEUE_SIZE 16u // power of two
+
+typedef struct {
+	int16_t steps; // > 0 = left, < 0 = right
+	uint16_t due; // step timer ticks
+} step_command_t;
+
+static step_command_t step_queue[STEP_QUEUE_SIZE];
+static volatile uint8_t step_queue_head = 0u; // written by the producer only
+static volatile uint8_t step_queue_tail = 0u; // written by the consumer only
+static int16_t step_queue_pending = 0; // producer side: steps that did not fit into a full queue
+static uint16_t step_queue_overruns = 0u;
+
+static void step_queue_push(int16_t steps, uint16_t due) {
+	uint8_t head = step_queue_head;
+	uint8_t next = (head + 1u) & (STEP_QUEUE_SIZE - 1u);
+
+	steps += step_queue_pending;
+	if (next == step_queue_tail) {
+		step_queue_pending = steps; // sent with the next command
+		step_queue_overruns++;
+		return;
+	}
+	step_queue_pending = 0;
+
+	step_queue[head].steps = steps;
+	step_queue[head].due = due;
+	step_queue_head = next;
+}
+
+/* long moves are split into several commands */
+static void step_queue_push_long(int32_t steps, uint16_t due) {
+	for (; steps < INT16_MIN; steps -= INT16_MIN) {
+		step_queue_push(INT16_MIN, due);
+	}
+	for (; steps > INT16_MAX; steps -= INT16_MAX) {
+		step_queue_push(INT16_MAX, due);
+	}
+	if (steps != 0) {
+		step_queue_push(steps, due);
+	}
+}
+
+uint16_t get_step_queue_overruns() {
+	return step_queue_overruns;
+}
 
 /******* support position recalculation *********/
-static volatile float step_multiplier_float = 1.;
-static volatile uint32_t required_support_position = 0;
+/* Exact rational gearing: required = spindle_steps * numerator / denominator (rounded down).
+ * The ratio is split into whole steps and a remainder per spindle step, so moving the
+ * spindle by one step costs only integer add/compare; the remainder accumulates in error. */
+static uint16_t gearing_whole = 1u; // numerator / denominator
+static uint16_t gearing_remainder = 0u; // numerator % denominator
+static uint16_t gearing_denominator = 1u;
+static uint16_t gearing_max_rpm = UINT16_MAX; // fastest spindle the support can follow
+
+typedef struct {
+	uint32_t spindle_steps; // spindle position the required position belongs to
+	uint32_t required;
+	uint16_t error; // always 0 <= error < gearing_denominator
+} gearing_t;
+
+/* Velocity feed-forward: the step generator gets the position geared gearing_lead spindle steps
+ * ahead, the distance the spindle turns while the planner would stop the support. The planner
+ * then runs ahead of the encoder instead of trailing it by its braking distance. */
+static gearing_t gearing_exact; // the spindle position itself
+static gearing_t gearing_predicted; // the spindle position + gearing_lead, fed to the step queue
+static uint32_t gearing_queued = 0u; // sum of the queued step commands
+static volatile int16_t gearing_lead_target = 0; // written by the main loop
+static int16_t gearing_lead = 0; // follows the target in the tick interrupt
+static uint8_t gearing_cutting = 0u; // the spindle is between the first turn and the end position
+static uint8_t gearing_hold = 0u; // the support waits at the start, see support_rewind()
+
+static volatile uint32_t required_support_position = 0; // encoder interrupt side, for the display
+static uint32_t step_target_position = 0; // step interrupt side, sum of the dequeued commands
 static uint32_t actual_support_position = 0;
 
-void support_set_fraction(float fraction) {
-	step_multiplier_float = fraction;
+/* following error (required - actual) over the last pass, sampled every 2 ms; beyond
+ * SUPPORT_FOLLOWING_ERROR_ALARM the alarm holds until the next pass, or stops the support */
+static uint16_t following_error_max = 0u;
+static volatile uint8_t following_error_alarm = 0u;
+static uint8_t support_stopped = 0u;
+static uint32_t following_error_square_sum = 0u;
+static uint16_t following_error_samples = 0u;
+
+static void gearing_reset(gearing_t *gearing) {
+	gearing->spindle_steps = 0u;
+	gearing->required = 0u;
+	gearing->error = 0u;
+}
+
+/* the same as gearing_step_forward() spindle_steps times */
+static void gearing_set(gearing_t *gearing, uint32_t spindle_steps) {
+	uint64_t remainders = (uint64_t)spindle_steps * gearing_remainder;
+	gearing->spindle_steps = spindle_steps;
+	gearing->required = spindle_steps * gearing_whole + (uint32_t)(remainders / gearing_denominator);
+	gearing->error = remainders % gearing_denominator;
+}
+
+/* Without the prediction the planner follows the spindle v^2 / (2 * SUPPORT_ACCELERATION) steps
+ * behind; that lag may take half of SUPPORT_FOLLOWING_ERROR_ALARM, the rest is for speed changes. */
+static uint16_t gearing_max_lagging_steps_per_second() {
+	uint32_t square = SUPPORT_ACCELERATION * SUPPORT_FOLLOWING_ERROR_ALARM; // v^2 = 2 * a * alarm / 2
+	uint32_t root = 0u;
+	for (uint32_t bit = 1ul << 15; bit; bit >>= 1) {
+		if ((root + bit) * (root + bit) <= square) {
+			root += bit;
+		}
+	}
+	return (root < SUPPORT_MAX_STEPS_PER_SECOND) ? root : SUPPORT_MAX_STEPS_PER_SECOND;
+}
+
+/* spindle speed at which the support reaches its speed limit, at most the speed at which the
+ * encoder edges come SPINDLE_MAX_EDGES_PER_SECOND */
+static uint16_t gearing_max_revolutions_per_minute(uint16_t numerator, uint16_t denominator, uint8_t prediction) {
+	uint32_t max_rpm = SPINDLE_MAX_EDGES_PER_SECOND * 60u / SPINDLE_STEPS_FOR_ONE_TURN;
+	if (numerator == 0u) {
+		return max_rpm;
+	}
+	uint32_t steps_per_second = prediction ? SUPPORT_MAX_STEPS_PER_SECOND : gearing_max_lagging_steps_per_second();
+	uint64_t rpm = (uint64_t)steps_per_second * 60u * denominator / ((uint32_t)SPINDLE_STEPS_FOR_ONE_TURN * numerator);
+	return (rpm > max_rpm) ? max_rpm : rpm;
+}
+
+uint16_t get_max_revolutions_per_minute() {
+	return gearing_max_rpm;
+}
+
+/* call before the spindle step counting is started, prediction = support_update_lead() is used */
+void support_set_fraction(uint16_t numerator, uint16_t denominator, uint8_t prediction) {
+	gearing_whole = numerator / denominator;
+	gearing_remainder = numerator % denominator;
+	gearing_denominator = denominator;
+	gearing_max_rpm = gearing_max_revolutions_per_minute(numerator, denominator, prediction);
+	gearing_reset(&gearing_exact);
+	gearing_reset(&gearing_predicted);
+	gearing_queued = 0u;
+	required_support_position = 0u;
 }
 
 uint32_t get_actual_support_position() {
@@ -21,81 +165,371 @@ uint32_t get_required_support_position() {
 	return required_support_position;
 }
 
-void recalculate_support_position(uint32_t current_spindle_revolution_steps) {
-	if (current_spindle_revolution_steps < STEPS_FOR_ONE_TURN) {
+static void gearing_step_forward(gearing_t *gearing) {
+	gearing->spindle_steps++;
+	gearing->required += gearing_whole;
+	if (gearing->error >= gearing_denominator - gearing_remainder) {
+		gearing->error -= gearing_denominator - gearing_remainder;
+		gearing->required++;
+	} else {
+		gearing->error += gearing_remainder;
+	}
+}
+
+static void gearing_step_backward(gearing_t *gearing) {
+	gearing->spindle_steps--;
+	gearing->required -= gearing_whole;
+	if (gearing->error < gearing_remainder) {
+		gearing->error += gearing_denominator - gearing_remainder;
+		gearing->required--;
+	} else {
+		gearing->error -= gearing_remainder;
+	}
+}
+
+/* The exact position moves by one spindle step per encoder interrupt. The predicted one jumps by up
+ * to the lead when the end position is latched or the hold is released, so it follows with at most
+ * max_steps per call and the rest comes with the next encoder or tick interrupts. */
+#define GEARING_EDGE_CATCH_UP_STEPS 2u // the spindle step itself and one more
+#define GEARING_TICK_CATCH_UP_STEPS 8u // every 2 ms, short enough to fit between two edges, the edges catch up the rest
+#define GEARING_LEAD_STEPS_PER_TICK 16 // the lead builds up at 8000 spindle steps/s at most
+
+static void gearing_move_to(gearing_t *gearing, uint32_t spindle_steps, uint8_t max_steps) {
+	for (; max_steps && (gearing->spindle_steps < spindle_steps); max_steps--) {
+		gearing_step_forward(gearing);
+	}
+	for (; max_steps && (gearing->spindle_steps > spindle_steps); max_steps--) {
+		gearing_step_backward(gearing);
+	}
+}
+
+/* spindle position that drives the support: nothing during the first turn, stop at the end position */
+static uint32_t gearing_limit(uint32_t current_spindle_revolution_steps) {
+	if (gearing_hold || (current_spindle_revolution_steps < SPINDLE_STEPS_FOR_ONE_TURN)) {
+		return 0;
+	}
+	uint32_t end_position = get_end_position();
+	if (current_spindle_revolution_steps > end_position) {
+		current_spindle_revolution_steps = end_position;
+	}
+	return current_spindle_revolution_steps - SPINDLE_STEPS_FOR_ONE_TURN; // skip the first turn
+}
+
+/* returns 1 when a step command was queued */
+static uint8_t gearing_predict(uint32_t current_spindle_revolution_steps, uint8_t max_steps) {
+	if ((gearing_lead < 0) && (current_spindle_revolution_steps < (uint16_t)-gearing_lead)) {
 		current_spindle_revolution_steps = 0;
 	} else {
-		uint32_t end_position = get_end_position();
-		if (current_spindle_revolution_steps > end_position) {
-			current_spindle_revolution_steps = end_position;
-		}
-		current_spindle_revolution_steps -= STEPS_FOR_ONE_TURN; // skip the first turn
+		current_spindle_revolution_steps += gearing_lead;
 	}
+	gearing_move_to(&gearing_predicted, gearing_limit(current_spindle_revolution_steps), max_steps);
 
-	required_support_position = current_spindle_revolution_steps * step_multiplier_float;
+	int32_t steps = gearing_predicted.required - gearing_queued; // above 1000:1 a catch-up exceeds int16_t
+	if (steps == 0) {
+		return 0;
+	}
+	step_queue_push_long(steps, hal_step_timer_now());
+	gearing_queued = gearing_predicted.required;
+	return 1;
+}
+
+void recalculate_support_position(uint32_t current_spindle_revolution_steps) {
+	gearing_cutting = (current_spindle_revolution_steps >= SPINDLE_STEPS_FOR_ONE_TURN) && (current_spindle_revolution_steps < get_end_position());
+	gearing_move_to(&gearing_exact, gearing_limit(current_spindle_revolution_steps), UINT8_MAX);
+	required_support_position = gearing_exact.required;
+	gearing_predict(current_spindle_revolution_steps, GEARING_EDGE_CATCH_UP_STEPS);
+}
+
+/* called from the 2 ms timer interrupt; the lead follows its target also while the spindle stands,
+ * so the support does not stay ahead after the spindle stopped */
+void support_update_prediction() {
+	int32_t difference = (int32_t)gearing_lead_target - gearing_lead;
+
+	if (difference > GEARING_LEAD_STEPS_PER_TICK) {
+		difference = GEARING_LEAD_STEPS_PER_TICK;
+	} else if (difference < -GEARING_LEAD_STEPS_PER_TICK) {
+		difference = -GEARING_LEAD_STEPS_PER_TICK;
+	}
+	gearing_lead += difference;
+	if (gearing_predict(get_current_spindle_revolution_steps(), GEARING_TICK_CATCH_UP_STEPS)) {
+		support_schedule_step();
+	}
+}
+
+/* The spindle position was moved back into the first turn: the support returns to the start at
+ * the planner's full speed and stays there until support_release(). Interrupts must be disabled. */
+void support_rewind() {
+	int32_t steps = -(int32_t)gearing_queued;
+
+	gearing_hold = 1u;
+	gearing_reset(&gearing_exact);
+	gearing_reset(&gearing_predicted);
+	required_support_position = 0u;
+	gearing_queued = 0u;
+	step_queue_push_long(steps, hal_step_timer_now());
+}
+
+/* After a power loss: the support stands at support_position and the spindle was turned back to
+ * the angle of spindle_steps. Call after support_set_fraction(), before the step counting starts;
+ * a difference to the required position is moved with the first spindle step. */
+void support_restore(uint32_t spindle_steps, uint32_t support_position) {
+	gearing_set(&gearing_exact, gearing_limit(spindle_steps));
+	gearing_predicted = gearing_exact;
+	required_support_position = gearing_exact.required;
+	actual_support_position = support_position;
+	step_target_position = support_position;
+	gearing_queued = gearing_exact.required;
+	step_queue_push_long(gearing_exact.required - support_position, hal_step_timer_now());
+}
+
+/* called from the encoder interrupt with the spindle position in the first turn */
+void support_release() {
+	gearing_hold = 0u;
+}
+
+/* call from the main loop with the measured spindle speed; lead = v_spindle * v_support / (2 * a) */
+void support_update_lead(int32_t spindle_steps_per_second) {
+	uint32_t spindle_speed = (spindle_steps_per_second < 0) ? -spindle_steps_per_second : spindle_steps_per_second;
+	uint64_t support_speed = (uint64_t)spindle_speed * gearing_whole + (uint64_t)spindle_speed * gearing_remainder / gearing_denominator; // 16 bit ratios overflow 32 bits
+	if (support_speed > SUPPORT_MAX_STEPS_PER_SECOND) {
+		support_speed = SUPPORT_MAX_STEPS_PER_SECOND;
+	}
+
+	uint64_t lead = spindle_speed * support_speed / (2u * SUPPORT_ACCELERATION);
+	if (lead > INT16_MAX) {
+		lead = INT16_MAX;
+	}
+
+	HAL_ATOMIC_BLOCK() {
+		gearing_lead_target = (spindle_steps_per_second < 0) ? -(int16_t)lead : (int16_t)lead;
+	}
+}
+
+/* called from the 2 ms timer interrupt; a new pass clears the statistics */
+void support_sample_following_error() {
+	static uint8_t was_cutting = 0;
+
+	if (!gearing_cutting) {
+		was_cutting = 0;
+		return;
+	}
+	if (!was_cutting) {
+		was_cutting = 1;
+		following_error_alarm = support_stopped;
+		following_error_max = 0;
+		following_error_square_sum = 0;
+		following_error_samples = 0;
+	}
+
+	int32_t error = required_support_position - actual_support_position;
+	uint16_t error_abs = (error < 0) ? ((error < -INT16_MAX) ? INT16_MAX : -error) : ((error > INT16_MAX) ? INT16_MAX : error);
+	uint32_t square = (uint32_t)error_abs * error_abs;
+
+	if (error_abs > following_error_max) {
+		following_error_max = error_abs;
+	}
+	if (error_abs > SUPPORT_FOLLOWING_ERROR_ALARM) {
+		following_error_alarm = 1u;
+#if SUPPORT_ALARM_DISABLES_DRIVER
+		support_stopped = 1u;
+		hal_driver_disable();
+#endif
+	}
+	diagnostics_following_error(error_abs);
+	if (following_error_samples < UINT16_MAX) {
+		following_error_samples++;
+		following_error_square_sum = (following_error_square_sum > UINT32_MAX - square) ? UINT32_MAX : following_error_square_sum + square;
+	}
+}
+
+uint16_t get_following_error_max() {
+	return following_error_max;
+}
+
+uint8_t support_alarm_is_active() {
+	return following_error_alarm;
 }
 
 /*********** stepper-motor ***************/
-static void stepper_do_pulse() {
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-		TCNT2 = 3;
-		TIFR2 = 0xFF; // clear all flags
+/* the pulse rises at step timer time 'due'; a late interrupt lets the previous pulse end first */
+static void stepper_do_pulse(uint16_t due) {
+	HAL_ATOMIC_BLOCK() {
+		while (hal_pulse_timer_is_running())
+			;
+		hal_pulse_timer_fire_at(due);
+	}
+}
+
+static void stepper_motor_move_step_left(uint16_t due) {
+	hal_driver_direction_left();
+	stepper_do_pulse(due);
+}
+
+static void stepper_motor_move_step_right(uint16_t due) {
+	hal_driver_direction_right();
+	stepper_do_pulse(due);
+}
+
+/*********** acceleration planner ***************/
+/* Linear speed ramp after Atmel AVR446: the delay between steps follows
+ * c(n) = c(n-1) - 2 * c(n-1) / (4 * n + 1), which keeps the acceleration constant with a single
+ * division per step. planner_ramp_steps is the number of steps the motor needs to stop from
+ * its current speed, so the motor decelerates as soon as the target is not further away.
+ * The delay keeps PLANNER_FRACTION_BITS below the tick: following a moving target the planner
+ * alternates single accelerating and decelerating steps whose change is below one tick, and a
+ * remainder carried between them would let the speed drift away from planner_ramp_steps. */
+#define PLANNER_FRACTION_BITS 8u
+
+static uint16_t planner_first_delay; // delay of the first step from standstill
+static uint16_t planner_min_delay; // delay at maximum speed
+static uint16_t planner_delay = 0u; // timer ticks to the next step
+static uint32_t planner_delay_fraction = 0u; // planner_delay << PLANNER_FRACTION_BITS with the fraction
+static uint16_t planner_ramp_steps = 0u;
+static int8_t planner_direction = 0; // 1 = left, -1 = right, 0 = standing
+
+uint16_t square_root(uint32_t value) {
+	uint32_t root = 0;
+	for (uint32_t bit = 1ul << 30; bit; bit >>= 2) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
 	}
+	return root;
 }
 
-static void stepper_motor_move_step_left() {
-	PORTC |= 1 << PORTC0;
-	stepper_do_pulse();
+uint16_t get_following_error_rms() {
+	uint32_t square_sum;
+	uint16_t samples;
+
+	HAL_ATOMIC_BLOCK() {
+		square_sum = following_error_square_sum;
+		samples = following_error_samples;
+	}
+	return samples ? square_root(square_sum / samples) : 0u;
 }
 
-static void stepper_motor_move_step_right() {
-	PORTC &= ~(1 << PORTC0);
-	stepper_do_pulse();
+static void planner_init() {
+	// c(0) = 0.676 * f * sqrt(2 / acceleration), 0.676 corrects the error of the first steps (AVR446)
+	uint32_t first_delay = (uint32_t)(0.676 * 1.4142 * HAL_STEP_TIMER_HZ) / square_root(SUPPORT_ACCELERATION);
+	planner_first_delay = (first_delay > UINT16_MAX) ? UINT16_MAX : first_delay;
+	planner_min_delay = HAL_STEP_TIMER_HZ / SUPPORT_MAX_STEPS_PER_SECOND;
 }
 
-// static uint8_t stepper_motor_move_was_finished() {
-//	return (TIFR2 == 0x07) && (TCNT2 <= 1);
-//}
+/* count > 0 accelerates to ramp step count, count < 0 decelerates from ramp step -count */
+static void planner_update_delay(int16_t count) {
+	int32_t delay = planner_delay_fraction - 2 * (int32_t)planner_delay_fraction / (4 * count + 1);
 
-static void stepper_motor_move_towards(uint32_t required_support_position) {
+	if (delay < ((int32_t)planner_min_delay << PLANNER_FRACTION_BITS)) {
+		delay = (int32_t)planner_min_delay << PLANNER_FRACTION_BITS;
+	} else if (delay > ((int32_t)planner_first_delay << PLANNER_FRACTION_BITS)) {
+		delay = (int32_t)planner_first_delay << PLANNER_FRACTION_BITS;
+	}
+	planner_delay_fraction = delay;
+	planner_delay = delay >> PLANNER_FRACTION_BITS;
+}
+
+static void planner_stand() {
+	planner_delay = planner_first_delay;
+	planner_delay_fraction = (uint32_t)planner_first_delay << PLANNER_FRACTION_BITS;
+	planner_ramp_steps = 0;
+}
 
-	if (actual_support_position < required_support_position) {
-		stepper_motor_move_step_left();
+/* plans the delay to the next step; distance = steps left to the target in the direction of motion */
+static void planner_next_step(int32_t distance) {
+	if (distance > planner_ramp_steps) {
+		if (planner_delay_fraction > ((uint32_t)planner_min_delay << PLANNER_FRACTION_BITS)) {
+			planner_ramp_steps++;
+			planner_update_delay(planner_ramp_steps);
+		}
+	} else if (planner_ramp_steps > 0) {
+		planner_update_delay(-(int16_t)planner_ramp_steps);
+		planner_ramp_steps--;
+	} else {
+		planner_direction = 0; // stopped, the direction is chosen again by the next step
+		planner_stand();
+	}
+}
+
+/* steps at 'due'; returns 0 when the support stands at the required position */
+static uint8_t stepper_motor_move_towards(uint32_t required_support_position, uint16_t due) {
+	int32_t distance = required_support_position - actual_support_position;
+
+	if (planner_direction == 0) {
+		if (distance == 0) {
+			return 0;
+		}
+		planner_direction = (distance > 0) ? 1 : -1;
+		planner_stand();
+	}
+
+	if (planner_direction > 0) {
+		stepper_motor_move_step_left(due);
 		actual_support_position++;
-	} else if (actual_support_position > required_support_position) {
-		stepper_motor_move_step_right();
+		distance--;
+	} else {
+		stepper_motor_move_step_right(due);
 		actual_support_position--;
+		distance = -distance - 1;
 	}
 
-	if (required_support_position != actual_support_position) {
-		TIMSK2 |= 1 << OCIE2A;
+	planner_next_step(distance);
+	return 1;
+}
+
+/* takes over all commands that are due; returns 0 when the queue is empty */
+static uint8_t step_queue_drain(uint16_t now) {
+	uint8_t tail = step_queue_tail;
+
+	while (tail != step_queue_head) {
+		if ((int16_t)(now - step_queue[tail].due) < 0) {
+			break; // not yet
+		}
+		step_target_position += step_queue[tail].steps;
+		tail = (tail + 1u) & (STEP_QUEUE_SIZE - 1u);
 	}
+	step_queue_tail = tail;
+	return tail != step_queue_head;
 }
 
-ISR(TIMER2_COMPA_vect) {
-	TIMSK2 &= ~(1 << OCIE2A); // disable interrupts
+HAL_ISR(TIMER1_COMPA_vect) {
+	hal_probe_support_begin();
+	uint16_t begin = diagnostics_time_begin();
 	
-	uint32_t requeired_support_position_tmp;
+	uint16_t due = hal_step_timer_compare() + SUPPORT_STEP_LEAD_TICKS;
+	uint8_t waiting = step_queue_drain(hal_step_timer_now());
 	
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { 
-		requeired_support_position_tmp = required_support_position;
+	if (support_stopped) {
+		hal_step_timer_irq_disable(); // after the alarm, until reset
+	} else if (stepper_motor_move_towards(step_target_position, due)) {
+		hal_step_timer_schedule_next(planner_delay);
+	} else if (waiting) {
+		hal_step_timer_schedule_at(step_queue[step_queue_tail].due);
+	} else {
+		hal_step_timer_irq_disable();
+	}
+	diagnostics_step_isr_end(begin);
+	hal_probe_support_end();
+}
+
+/* called from the encoder interrupt; starts the step timer when the support stands still */
+void support_schedule_step() {
+	if (!support_stopped && !hal_step_timer_irq_is_enabled()) {
+		hal_step_timer_schedule_next(SUPPORT_WAKE_UP_TICKS);
+		hal_step_timer_irq_enable();
 	}
-	
-	stepper_motor_move_towards(requeired_support_position_tmp);
 }
 
 void support_init() {
-	DDRC |= 1 << DDC2; // Driver Enable
-	DDRD |= 1 << DDD3; // Driver Pulse
-	DDRC |= 1 << DDC0; // Driver Direction
-	PORTC |= 1 << PORTC2; // Driver Enable -> 1 = enabled
-		
-	/* we are using this timer as a one shot timer https://hackaday.com/2015/03/24/avr-hardware-timer-tricked-into-one-shot/ */
-	TCCR2A = (1 << COM2B1) | (1 << COM2B0) | (1 << WGM21) | (1 << WGM20);
-	//TCCR2B = (1 << WGM22) | (1 << CS21) | (1 << CS20); // CLK / 64
-	TCCR2B = (1 << WGM22) | (1 << CS21); // CLK / 8
-	OCR2A = 0;
-	OCR2B = 200;
+	hal_driver_init();
+	hal_driver_enable();
+	hal_timers_halt();
+	hal_pulse_timer_init();
+	hal_step_timer_init();
+	hal_timers_start();
+	planner_init();
 	
-	stepper_motor_move_step_right(); // init Timer's flags;
+	stepper_motor_move_step_right(hal_step_timer_now()); // init Timer's flags;
 }
@@ -4,11 +4,25 @@
 #include <stdint.h>
 
 void support_init();
-void support_set_fraction(float fraction);
+void support_set_fraction(uint16_t numerator, uint16_t denominator, uint8_t prediction);
 
 void recalculate_support_position(uint32_t current_spindle_revolution_steps);
+void support_schedule_step();
+void support_update_lead(int32_t spindle_steps_per_second);
+void support_sample_following_error();
+void support_update_prediction();
+void support_rewind();
+void support_release();
+void support_restore(uint32_t spindle_steps, uint32_t support_position);
 
 uint32_t get_actual_support_position();
 uint32_t get_required_support_position();
+uint16_t get_step_queue_overruns();
+uint16_t get_following_error_max();
+uint16_t get_following_error_rms();
+uint16_t get_max_revolutions_per_minute();
+uint8_t support_alarm_is_active();
+
+uint16_t square_root(uint32_t value);
 
 #endif /* SUPPORT_H_ */
\ No newline at end of file
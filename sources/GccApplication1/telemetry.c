@@ -0,0 +1,159 @@
+#include "telemetry.h"
+
+#if TELEMETRY
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "hal.h"
+#include "revolutions.h"
+#include "support.h"
+#include "spindle.h"
+
+#if TELEMETRY_EDGES
+#if (TELEMETRY_EDGES & (TELEMETRY_EDGES - 1)) || (TELEMETRY_EDGES > 64)
+#error "TELEMETRY_EDGES must be a power of two up to 64, a frame full of edges has to fit into the buffer"
+#endif
+#define TELEMETRY_BUFFER_SIZE 256u // power of two, a frame with 63 edges and the next one
+#else
+#define TELEMETRY_BUFFER_SIZE 128u // power of two, five frames
+#endif
+
+typedef struct {
+	uint8_t sequence;
+	uint32_t timestamp;
+	uint32_t spindle_position;
+	uint32_t required_support_position;
+	uint32_t actual_support_position;
+	int16_t revolutions_per_minute;
+	uint8_t edge_count;
+	uint8_t edges_lost;
+} telemetry_frame_t;
+
+#define TELEMETRY_FRAME_LENGTH (1u + sizeof(telemetry_frame_t) + 1u) // sync, frame, CRC, without edges
+
+#if TELEMETRY_EDGES
+/* Filled by the encoder interrupt, emptied by the main loop; each side writes only its own index.
+ * The tick interrupt counts the edges of its frame while the main loop is not sending. */
+static uint16_t telemetry_edges[TELEMETRY_EDGES];
+static volatile uint8_t telemetry_edge_head = 0u;
+static volatile uint8_t telemetry_edge_tail = 0u;
+static uint8_t telemetry_edges_lost = 0u; // the encoder and the tick interrupt, they do not nest
+#endif
+
+/* The tick interrupt only copies the positions into the sample slot while it is empty, the main
+ * loop adds the speed and the CRC and queues the frame. */
+static telemetry_frame_t telemetry_sample_frame;
+static volatile uint8_t telemetry_sample_full = 0u;
+static uint8_t telemetry_sequence = 0u; // the tick interrupt only
+
+/* Filled by the main loop, drained by USART_UDRE_vect; each side writes only its own index. */
+static uint8_t telemetry_buffer[TELEMETRY_BUFFER_SIZE];
+static volatile uint8_t telemetry_head = 0u;
+static volatile uint8_t telemetry_tail = 0u;
+
+void telemetry_init() {
+	hal_uart_init();
+}
+
+static uint8_t telemetry_put(uint8_t head, uint8_t value) {
+	telemetry_buffer[head] = value;
+	return (head + 1u) & (TELEMETRY_BUFFER_SIZE - 1u);
+}
+
+static uint8_t telemetry_put_bytes(uint8_t head, const uint8_t *bytes, uint8_t length, uint8_t *crc) {
+	for (uint8_t i = 0; i < length; i++) {
+		*crc = _crc8_ccitt_update(*crc, bytes[i]);
+		head = telemetry_put(head, bytes[i]);
+	}
+	return head;
+}
+
+#if TELEMETRY_EDGES
+/* called from the encoder interrupt for every spindle step */
+void telemetry_edge(uint32_t timestamp, uint8_t rotate_left) {
+	uint8_t head = telemetry_edge_head;
+	uint8_t next = (head + 1u) & (TELEMETRY_EDGES - 1u);
+
+	if (next == telemetry_edge_tail) {
+		if (telemetry_edges_lost < UINT8_MAX) {
+			telemetry_edges_lost++;
+		}
+		return;
+	}
+	telemetry_edges[head] = ((uint16_t)timestamp & 0xFFFEu) | (rotate_left ? 1u : 0u);
+	telemetry_edge_head = next;
+}
+#endif
+
+/* called from the tick interrupt; a sample the main loop did not take yet drops this one, its
+ * edges go with the next frame */
+void telemetry_sample() {
+	uint8_t sequence = telemetry_sequence++;
+
+	if (telemetry_sample_full) {
+		return;
+	}
+
+	telemetry_sample_frame.sequence = sequence;
+	telemetry_sample_frame.timestamp = step_timer_timestamp();
+	telemetry_sample_frame.spindle_position = get_current_spindle_revolution_steps();
+	telemetry_sample_frame.required_support_position = get_required_support_position();
+	telemetry_sample_frame.actual_support_position = get_actual_support_position();
+#if TELEMETRY_EDGES
+	telemetry_sample_frame.edge_count = (telemetry_edge_head - telemetry_edge_tail) & (TELEMETRY_EDGES - 1u);
+	telemetry_sample_frame.edges_lost = telemetry_edges_lost;
+	telemetry_edges_lost = 0u;
+#else
+	telemetry_sample_frame.edge_count = 0u;
+	telemetry_sample_frame.edges_lost = 0u;
+#endif
+	telemetry_sample_full = 1u;
+}
+
+/* main loop task, every tick */
+void telemetry_send() {
+	if (!telemetry_sample_full) {
+		return;
+	}
+
+	uint8_t head = telemetry_head;
+	uint8_t free = (telemetry_tail - head - 1u) & (TELEMETRY_BUFFER_SIZE - 1u);
+	uint8_t edge_count = telemetry_sample_frame.edge_count;
+
+	if (free >= TELEMETRY_FRAME_LENGTH + edge_count * sizeof(uint16_t)) { // else dropped, the gap shows in the sequence
+		telemetry_sample_frame.revolutions_per_minute = get_revolutions_per_minute();
+
+		uint8_t crc = 0u;
+		head = telemetry_put(head, TELEMETRY_SYNC);
+		head = telemetry_put_bytes(head, (const uint8_t *)&telemetry_sample_frame, sizeof(telemetry_sample_frame), &crc);
+#if TELEMETRY_EDGES
+		uint8_t edge = telemetry_edge_tail;
+		for (uint8_t i = 0; i < edge_count; i++) {
+			head = telemetry_put_bytes(head, (const uint8_t *)&telemetry_edges[edge], sizeof(telemetry_edges[0]), &crc);
+			edge = (edge + 1u) & (TELEMETRY_EDGES - 1u);
+		}
+#endif
+		head = telemetry_put(head, crc);
+
+		telemetry_head = head;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			hal_uart_irq_enable();
+		}
+	}
+#if TELEMETRY_EDGES
+	telemetry_edge_tail = (telemetry_edge_tail + edge_count) & (TELEMETRY_EDGES - 1u); // sent or dropped with the frame
+#endif
+	telemetry_sample_full = 0u;
+}
+
+ISR(USART_UDRE_vect) {
+	uint8_t tail = telemetry_tail;
+
+	if (tail == telemetry_head) {
+		hal_uart_irq_disable();
+		return;
+	}
+	hal_uart_write(telemetry_buffer[tail]);
+	telemetry_tail = (tail + 1u) & (TELEMETRY_BUFFER_SIZE - 1u);
+}
+#endif
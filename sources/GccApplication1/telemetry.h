@@ -0,0 +1,42 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+#include "main.h"
+
+/*
+ * Binary frames with the spindle and support state on the USART at 1 Mbaud, one every 2 ms:
+ *   0xA5, sequence, Timer1 timestamp (uint32, 0.5 us), spindle position (uint32),
+ *   required support position (uint32), actual support position (uint32), RPM (int16),
+ *   edge count (uint8), lost edges (uint8), edges (uint16 each), CRC-8
+ * little endian, the CRC covers everything after 0xA5. The tick interrupt only copies the
+ * positions (telemetry_sample), the main loop task telemetry_send adds the RPM and the CRC, so a
+ * frame the main loop did not take before the next tick or that does not fit into the transmit
+ * buffer is dropped, the gap shows in the sequence. tools/telemetry_decode.py writes CSV.
+ *
+ * With TELEMETRY_EDGES every encoder step is recorded as bits 15..1 of its Timer1 timestamp with
+ * the direction (1 = rotate left) in bit 0, so a cut can be replayed edge by edge (tools/host).
+ * The encoder interrupt puts the steps into a ring of TELEMETRY_EDGES entries and the next frame
+ * carries all of them; steps beyond TELEMETRY_EDGES - 1 per frame are only counted as lost (about
+ * 780 RPM with 64).
+ */
+
+#define TELEMETRY_SYNC 0xA5u
+
+#if TELEMETRY
+void telemetry_init();
+void telemetry_sample();
+void telemetry_send();
+#else
+static inline void telemetry_init() {}
+static inline void telemetry_sample() {}
+static inline void telemetry_send() {}
+#endif
+
+#if TELEMETRY && TELEMETRY_EDGES
+void telemetry_edge(uint32_t timestamp, uint8_t rotate_left);
+#else
+static inline void telemetry_edge(uint32_t timestamp, uint8_t rotate_left) { (void)timestamp; (void)rotate_left; }
+#endif
+
+#endif /* TELEMETRY_H_ */
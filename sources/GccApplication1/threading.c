@@ -0,0 +1,121 @@
+#include "threading.h"
+#include <util/atomic.h>
+#include "main.h"
+#include "buttons.h"
+#include "lcd.h"
+#include "setup_menu.h"
+#include "support.h"
+#include "spindle.h"
+
+/******* automatic threading cycle ******/
+/* Only the support (Z) is driven by the motor, the cross slide stays manual. The first pass is
+ * cut as before and ends with button 1 latching the end position. After every pass the operator
+ * retracts the tool and confirms with button 1, the support returns to the start at full speed
+ * while the spindle keeps turning, and the display shows the total infeed of the next pass.
+ * Button 1 then re-engages the support at the spindle angle of the first pass. After the last
+ * pass button 1 returns the support the same way and the next thread starts with the first pass. */
+typedef enum {
+	THREADING_CUTTING,
+	THREADING_RETRACT, // waiting for the operator to retract the tool
+	THREADING_RETURN, // the support is returning to the start
+	THREADING_INFEED, // waiting for the operator to set the infeed of the next pass
+	THREADING_DONE
+} threading_state_t;
+
+static threading_state_t threading_state = THREADING_CUTTING;
+static uint8_t threading_pass = 1u;
+static uint8_t threading_button_was_pressed = 1u; // must be released first
+
+uint8_t threading_is_enabled() {
+	return get_configured_passes() > 0u;
+}
+
+/* total infeed of the pass in hundredths of mm: depth * sqrt(pass / passes), every pass removes the same chip area */
+static uint16_t threading_pass_depth(uint8_t pass) {
+	uint32_t depth = get_configured_depth();
+	return square_root(depth * depth * pass / get_configured_passes());
+}
+
+static uint8_t threading_button_1_was_pushed() {
+	uint8_t pressed = button_1_is_pressed();
+	uint8_t pushed = pressed && !threading_button_was_pressed;
+	threading_button_was_pressed = pressed;
+	return pushed;
+}
+
+static uint8_t threading_support_is_home() {
+	uint32_t position;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		position = get_actual_support_position();
+	}
+	return position == 0u;
+}
+
+/* called from the main loop */
+void threading_update() {
+	uint8_t pushed = threading_button_1_was_pushed();
+
+	if (!threading_is_enabled()) {
+		return;
+	}
+
+	switch (threading_state) {
+		case THREADING_CUTTING:
+			if (spindle_is_past_end()) {
+				threading_state = (threading_pass >= get_configured_passes()) ? THREADING_DONE : THREADING_RETRACT;
+			}
+			break;
+		case THREADING_RETRACT:
+			if (pushed) {
+				spindle_rewind();
+				threading_state = THREADING_RETURN;
+			}
+			break;
+		case THREADING_RETURN:
+			if (threading_support_is_home()) {
+				threading_pass++;
+				threading_state = THREADING_INFEED;
+			}
+			break;
+		case THREADING_INFEED:
+			if (pushed) {
+				spindle_release();
+				threading_state = THREADING_CUTTING;
+			}
+			break;
+		case THREADING_DONE:
+			if (pushed) {
+				spindle_rewind();
+				threading_pass = 0u; // THREADING_RETURN counts the first pass
+				threading_state = THREADING_RETURN;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void threading_display() {
+	switch (threading_state) {
+		case THREADING_RETRACT:
+			lcd_puts("odjed nozem -> tl. 1");
+			break;
+		case THREADING_RETURN:
+			lcd_puts("vraceni suportu     ");
+			break;
+		case THREADING_INFEED:
+			lcd_puts("prisun ");
+			lcd_put_fixed(threading_pass_depth(threading_pass), 2, 4);
+			lcd_puts("mm, tl. 1");
+			break;
+		default:
+			lcd_puts((threading_state == THREADING_DONE) ? "hotovo  " : "pruchod ");
+			lcd_put_unsigned(threading_pass, 2, ' ');
+			lcd_put_char('/');
+			lcd_put_unsigned(get_configured_passes(), 2, ' ');
+			lcd_put_char(' ');
+			lcd_put_fixed(threading_pass_depth(threading_pass), 2, 4);
+			lcd_puts("mm");
+			break;
+	}
+}
@@ -0,0 +1,10 @@
+#ifndef THREADING_H_
+#define THREADING_H_
+
+#include <stdint.h>
+
+uint8_t threading_is_enabled();
+void threading_update();
+void threading_display();
+
+#endif /* THREADING_H_ */
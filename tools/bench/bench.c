@@ -0,0 +1,321 @@
+/*
+ * Cycle counts of the interrupt handlers of the real firmware image under simavr. The image is
+ * built with ISR_PROBES (see hal.h), which holds a pin high while a handler runs:
+ *   PB3 = INT0_vect and PCINT0_vect (encoder), PB4 = TIMER1_COMPA_vect (step), PD5 = TIMER0_COMPA_vect (tick)
+ * The bench turns the encoder at a constant speed and reports per vector the min/avg/max cycles
+ * between the probe edges, the entry latency from the encoder edge to the encoder probe and the
+ * distance from the last encoder edge to each step edge on PD3, and writes a VCD trace.
+ *
+ *   bench -f firmware.elf [-r rpm] [-t seconds] [-v trace.vcd] [-E cycles] [-S cycles] [-T cycles]
+ *
+ * -E, -S and -T are the budgets of the encoder, step and tick handlers; the bench exits with 1
+ * when a handler exceeds its budget or the support made no step. The probe pulses do not cover
+ * the prologue and epilogue the compiler adds, about 40 cycles more per handler. The default speed
+ * is the fastest the firmware advises, where the encoder edges come closest.
+ *
+ * The EEPROM of a new chip is blank, so the first boot opens the setup menu. The bench clicks
+ * through it with button 1 until the encoder interrupt is enabled, the menu has then saved its
+ * defaults; after a reset the second boot loads them without the menu and the measurement starts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <sim_vcd_file.h>
+#include <avr_ioport.h>
+#include <avr_twi.h>
+
+#define BENCH_F_CPU 16000000ul
+#define BENCH_SPINDLE_STEPS_FOR_ONE_TURN 2400u // main.h
+#define BENCH_LCD_ADDRESS 0x27u // LCD_DISPLAY_ADDRESS in main.h
+#define BENCH_EIMSK 0x3Du // data address, INT0 is enabled by init_step_counting()
+#define BENCH_INT0 0u
+#define BENCH_BUTTON_CYCLES (BENCH_F_CPU / 25u) // 40 ms pressed, 40 ms released
+#define BENCH_BOOT_CYCLES (10u * BENCH_F_CPU) // the menu has 20 items at most
+
+#define BENCH_MAX_EDGES_PER_SECOND 12000u // SPINDLE_MAX_EDGES_PER_SECOND in main.h, 300 ot/min
+#define BENCH_EDGE_SPACING (BENCH_F_CPU / BENCH_MAX_EDGES_PER_SECOND) // 1333 cycles
+#define BENCH_PROLOGUE_CYCLES 40u // per handler, outside of the probe pulse
+
+/* budgets in cycles: the encoder handler has to end within SUPPORT_STEP_LEAD_TICKS (24 us). An
+ * edge that comes while the tick handler runs waits for it and has to be decoded before the next
+ * edge, so the tick handler and the entry of the encoder handler fit in the edge spacing. */
+#define BENCH_ENCODER_BUDGET 384u
+#define BENCH_STEP_BUDGET 640u
+#define BENCH_TICK_BUDGET (BENCH_EDGE_SPACING - 2u * BENCH_PROLOGUE_CYCLES) // 1253
+
+typedef struct {
+	const char *name;
+	uint32_t budget; // 0 = none
+	avr_cycle_count_t begin; // cycle of the rising probe edge, 0 = the probe is low
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+} bench_stat_t;
+
+static bench_stat_t bench_encoder = { "INT0/PCINT0 (PB3)", BENCH_ENCODER_BUDGET, 0, 0, UINT32_MAX, 0, 0 };
+static bench_stat_t bench_step = { "TIMER1_COMPA (PB4)", BENCH_STEP_BUDGET, 0, 0, UINT32_MAX, 0, 0 };
+static bench_stat_t bench_tick = { "TIMER0_COMPA (PD5)", BENCH_TICK_BUDGET, 0, 0, UINT32_MAX, 0, 0 };
+static bench_stat_t bench_entry = { "encoder edge to PB3", 0, 0, 0, UINT32_MAX, 0, 0 };
+static bench_stat_t bench_step_edge = { "encoder edge to PD3", 0, 0, 0, UINT32_MAX, 0, 0 };
+
+static avr_t *bench_avr = NULL;
+static uint8_t bench_measuring = 0u;
+static avr_cycle_count_t bench_encoder_edge = 0; // cycle of the last encoder edge
+
+static void bench_add(bench_stat_t *stat, uint32_t cycles) {
+	if (!bench_measuring) {
+		return;
+	}
+	stat->count++;
+	stat->sum += cycles;
+	if (cycles < stat->min) {
+		stat->min = cycles;
+	}
+	if (cycles > stat->max) {
+		stat->max = cycles;
+	}
+}
+
+/******* probes ******/
+static void bench_probe_hook(struct avr_irq_t *irq, uint32_t value, void *param) {
+	bench_stat_t *stat = param;
+	(void)irq;
+
+	if (value) {
+		stat->begin = bench_avr->cycle;
+		if ((stat == &bench_encoder) && bench_encoder_edge) {
+			bench_add(&bench_entry, bench_avr->cycle - bench_encoder_edge);
+		}
+	} else if (stat->begin) {
+		bench_add(stat, bench_avr->cycle - stat->begin);
+		stat->begin = 0;
+	}
+}
+
+static void bench_step_hook(struct avr_irq_t *irq, uint32_t value, void *param) {
+	(void)irq;
+	(void)param;
+	if (value && bench_encoder_edge) {
+		bench_add(&bench_step_edge, bench_avr->cycle - bench_encoder_edge);
+	}
+}
+
+/******* LCD backpack on the I2C bus, acknowledges everything sent to it ******/
+static avr_irq_t *bench_twi_input = NULL;
+static uint8_t bench_twi_selected = 0u;
+
+static void bench_twi_hook(struct avr_irq_t *irq, uint32_t value, void *param) {
+	avr_twi_msg_irq_t message;
+	(void)irq;
+	(void)param;
+
+	message.u.v = value;
+	if (message.u.twi.msg & (TWI_COND_START | TWI_COND_STOP)) {
+		bench_twi_selected = 0u;
+	}
+	if ((message.u.twi.msg & TWI_COND_ADDR) && ((message.u.twi.data >> 1) == BENCH_LCD_ADDRESS)) {
+		bench_twi_selected = 1u;
+		avr_raise_irq(bench_twi_input, avr_twi_irq_msg(TWI_COND_ACK, message.u.twi.data, 1));
+	} else if (bench_twi_selected && (message.u.twi.msg & TWI_COND_WRITE)) {
+		avr_raise_irq(bench_twi_input, avr_twi_irq_msg(TWI_COND_ACK, BENCH_LCD_ADDRESS << 1, 1));
+	}
+}
+
+/******* inputs ******/
+static avr_irq_t *bench_yellow = NULL; // PD2
+static avr_irq_t *bench_green = NULL; // PB2
+static avr_irq_t *bench_button_1 = NULL; // PD4, low = pressed
+
+static avr_cycle_count_t bench_button_timer(struct avr_t *avr, avr_cycle_count_t when, void *param) {
+	static uint8_t pressed = 0u;
+	(void)avr;
+	(void)param;
+
+	pressed = !pressed;
+	avr_raise_irq(bench_button_1, pressed ? 0 : 1);
+	return when + BENCH_BUTTON_CYCLES;
+}
+
+/* yellow << 1 | green, counting up: 00 -> 01 -> 11 -> 10 */
+static const uint8_t bench_encoder_sequence[4] = { 0u, 1u, 3u, 2u };
+static double bench_edge_cycles = 0.0;
+static double bench_edge_rest = 0.0;
+
+static avr_cycle_count_t bench_encoder_timer(struct avr_t *avr, avr_cycle_count_t when, void *param) {
+	static uint8_t phase = 0u;
+	(void)param;
+
+	phase = (phase + 1u) & 3u;
+	avr_raise_irq(bench_yellow, (bench_encoder_sequence[phase] >> 1) & 1u);
+	avr_raise_irq(bench_green, bench_encoder_sequence[phase] & 1u);
+	bench_encoder_edge = avr->cycle;
+
+	bench_edge_rest += bench_edge_cycles;
+	avr_cycle_count_t next = (avr_cycle_count_t)bench_edge_rest;
+	bench_edge_rest -= next;
+	return when + next;
+}
+
+/******* run ******/
+static uint8_t bench_encoder_enabled(avr_t *avr) {
+	return avr->data[BENCH_EIMSK] & (1u << BENCH_INT0);
+}
+
+/* runs until 'cycles' elapsed or until done() returns 1; returns 0 on a crash */
+static uint8_t bench_run(avr_t *avr, avr_cycle_count_t cycles, uint8_t (*done)(avr_t *)) {
+	avr_cycle_count_t end = avr->cycle + cycles;
+
+	while (avr->cycle < end) {
+		int state = avr_run(avr);
+		if ((state == cpu_Done) || (state == cpu_Crashed)) {
+			return 0;
+		}
+		if (done && done(avr)) {
+			return 1;
+		}
+	}
+	return !done;
+}
+
+static void bench_print(const bench_stat_t *stat) {
+	if (!stat->count) {
+		printf("%-22s %8u      -      -      -\n", stat->name, 0u);
+		return;
+	}
+	printf("%-22s %8u %6u %6llu %6u", stat->name, stat->count, stat->min, (unsigned long long)(stat->sum / stat->count), stat->max);
+	if (stat->budget) {
+		printf("  %6u%s", stat->budget, (stat->max > stat->budget) ? "  OVER" : "");
+	}
+	printf("\n");
+}
+
+static avr_irq_t *bench_pin(avr_t *avr, char port, int pin) {
+	return avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), pin);
+}
+
+int main(int argc, char *argv[]) {
+	const char *firmware_name = NULL;
+	const char *vcd_name = NULL;
+	double rpm = 60.0 * BENCH_MAX_EDGES_PER_SECOND / BENCH_SPINDLE_STEPS_FOR_ONE_TURN;
+	double seconds = 2.0;
+	elf_firmware_t firmware = { 0 };
+	avr_vcd_t vcd;
+	int option;
+
+	while ((option = getopt(argc, argv, "f:r:t:v:E:S:T:")) != -1) {
+		switch (option) {
+		case 'f': firmware_name = optarg; break;
+		case 'r': rpm = atof(optarg); break;
+		case 't': seconds = atof(optarg); break;
+		case 'v': vcd_name = optarg; break;
+		case 'E': bench_encoder.budget = atoi(optarg); break;
+		case 'S': bench_step.budget = atoi(optarg); break;
+		case 'T': bench_tick.budget = atoi(optarg); break;
+		default:
+			firmware_name = NULL;
+			break;
+		}
+	}
+	if (!firmware_name || (rpm <= 0.0)) {
+		fprintf(stderr, "usage: %s -f firmware.elf [-r rpm] [-t seconds] [-v trace.vcd] [-E cycles] [-S cycles] [-T cycles]\n", argv[0]);
+		return 2;
+	}
+	if (elf_read_firmware(firmware_name, &firmware) != 0) {
+		fprintf(stderr, "%s: cannot read the firmware\n", firmware_name);
+		return 2;
+	}
+
+	avr_t *avr = avr_make_mcu_by_name("atmega328p");
+	if (!avr) {
+		fprintf(stderr, "simavr has no atmega328p\n");
+		return 2;
+	}
+	bench_avr = avr;
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+	avr->frequency = BENCH_F_CPU;
+
+	bench_yellow = bench_pin(avr, 'D', 2);
+	bench_green = bench_pin(avr, 'B', 2);
+	bench_button_1 = bench_pin(avr, 'D', 4);
+	avr_raise_irq(bench_pin(avr, 'D', 6), 1); // the other buttons released
+	avr_raise_irq(bench_pin(avr, 'D', 7), 1);
+	avr_raise_irq(bench_pin(avr, 'B', 0), 1);
+	avr_raise_irq(bench_pin(avr, 'B', 1), 1);
+	avr_raise_irq(bench_button_1, 1);
+	avr_raise_irq(bench_yellow, 0);
+	avr_raise_irq(bench_green, 0);
+
+	bench_twi_input = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), bench_twi_hook, NULL);
+	avr_irq_register_notify(bench_pin(avr, 'B', 3), bench_probe_hook, &bench_encoder);
+	avr_irq_register_notify(bench_pin(avr, 'B', 4), bench_probe_hook, &bench_step);
+	avr_irq_register_notify(bench_pin(avr, 'D', 5), bench_probe_hook, &bench_tick);
+	avr_irq_register_notify(bench_pin(avr, 'D', 3), bench_step_hook, NULL);
+
+	// first boot: the setup menu saves its defaults
+	avr_cycle_timer_register(avr, BENCH_BUTTON_CYCLES, bench_button_timer, NULL);
+	if (!bench_run(avr, BENCH_BOOT_CYCLES, bench_encoder_enabled)) {
+		fprintf(stderr, "FAIL: the firmware did not leave the setup menu\n");
+		return 1;
+	}
+	avr_cycle_timer_cancel(avr, bench_button_timer, NULL);
+	avr_raise_irq(bench_button_1, 1);
+
+	// second boot: the saved setup, no menu
+	avr_reset(avr);
+	if (!bench_run(avr, BENCH_BOOT_CYCLES, bench_encoder_enabled)) {
+		fprintf(stderr, "FAIL: the firmware did not start after the reset\n");
+		return 1;
+	}
+
+	if (vcd_name) {
+		avr_vcd_init(avr, vcd_name, &vcd, 100000);
+		avr_vcd_add_signal(&vcd, bench_yellow, 1, "encoder_yellow_PD2");
+		avr_vcd_add_signal(&vcd, bench_green, 1, "encoder_green_PB2");
+		avr_vcd_add_signal(&vcd, bench_pin(avr, 'B', 3), 1, "encoder_isr_PB3");
+		avr_vcd_add_signal(&vcd, bench_pin(avr, 'B', 4), 1, "step_isr_PB4");
+		avr_vcd_add_signal(&vcd, bench_pin(avr, 'D', 5), 1, "tick_isr_PD5");
+		avr_vcd_add_signal(&vcd, bench_pin(avr, 'D', 3), 1, "pulse_PD3");
+		avr_vcd_add_signal(&vcd, bench_pin(avr, 'C', 0), 1, "direction_PC0");
+		avr_vcd_start(&vcd);
+	}
+
+	bench_edge_cycles = 60.0 * BENCH_F_CPU / (rpm * BENCH_SPINDLE_STEPS_FOR_ONE_TURN);
+	bench_measuring = 1u;
+	avr_cycle_timer_register(avr, (avr_cycle_count_t)bench_edge_cycles, bench_encoder_timer, NULL);
+	uint8_t ok = bench_run(avr, (avr_cycle_count_t)(seconds * BENCH_F_CPU), NULL);
+
+	if (vcd_name) {
+		avr_vcd_stop(&vcd);
+	}
+
+	printf("%.0f RPM for %.1f s, %.1f cycles between encoder edges\n", rpm, seconds, bench_edge_cycles);
+	printf("%-22s %8s %6s %6s %6s  %6s\n", "cycles", "count", "min", "avg", "max", "budget");
+	bench_print(&bench_encoder);
+	bench_print(&bench_step);
+	bench_print(&bench_tick);
+	bench_print(&bench_entry);
+	bench_print(&bench_step_edge);
+
+	if (!ok) {
+		printf("FAIL: the firmware crashed\n");
+		return 1;
+	}
+	if (!bench_step_edge.count) {
+		printf("FAIL: no step edge on PD3\n");
+		return 1;
+	}
+	if ((bench_encoder.max > bench_encoder.budget) || (bench_step.max > bench_step.budget) || (bench_tick.max > bench_tick.budget)) {
+		printf("FAIL: over the budget\n");
+		return 1;
+	}
+	return 0;
+}
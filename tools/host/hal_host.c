@@ -0,0 +1,3 @@
+#include "hal.h"
+
+hal_host_t hal_host;
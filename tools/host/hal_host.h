@@ -0,0 +1,154 @@
+/*
+ * Host implementation of hal.h for the simulator, selected with HAL_HOST (see the Makefile).
+ * The registers become fields of hal_host, a virtual ATmega328P that counts Timer1 ticks;
+ * sim.c advances the time and calls the interrupt handlers when their events come due, always
+ * between two handlers, so HAL_ATOMIC_BLOCK() needs to disable nothing.
+ * Only the functions used by spindle.c, support.c and revolutions.c are implemented.
+ */
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+
+#define HAL_ISR(vector) void hal_host_##vector()
+#define HAL_ATOMIC_BLOCK() for (uint8_t hal_atomic_once = 1u; hal_atomic_once; hal_atomic_once = 0u)
+
+typedef struct {
+	uint32_t now; // Timer1 ticks since the start
+	uint16_t compare; // OCR1A
+	uint8_t step_irq_enabled; // OCIE1A
+	uint8_t overflow_irq_enabled; // TOIE1
+	uint8_t overflow_pending; // TOV1
+	uint8_t tick_enabled; // OCIE0A
+	uint8_t encoder; // yellow << 1 | green
+	uint8_t encoder_enabled; // INT0 and PCINT2
+	uint8_t driver_enabled;
+	uint8_t direction_left;
+} hal_host_t;
+
+extern hal_host_t hal_host;
+
+/* the rising edge of a driver pulse, recorded by the simulator */
+void hal_host_pulse(uint32_t time, uint8_t direction_left);
+
+static inline void hal_irq_enable() {}
+static inline void hal_pull_ups_init() {}
+
+/******* spindle encoder ******/
+static inline void hal_encoder_init() {
+	hal_host.encoder_enabled = 1u;
+}
+
+static inline uint8_t hal_encoder_state() {
+	return hal_host.encoder;
+}
+
+/******* stepper-motor driver ******/
+static inline void hal_driver_init() {}
+
+static inline void hal_driver_enable() {
+	hal_host.driver_enabled = 1u;
+}
+
+static inline void hal_driver_disable() {
+	hal_host.driver_enabled = 0u;
+}
+
+static inline void hal_driver_direction_left() {
+	hal_host.direction_left = 1u;
+}
+
+static inline void hal_driver_direction_right() {
+	hal_host.direction_left = 0u;
+}
+
+/******* Timer 2 - one shot pulse for the driver ******/
+#define HAL_PULSE_MAX_DELAY_TICKS (256u - HAL_PULSE_WIDTH_TICKS - 1u)
+
+static inline void hal_pulse_timer_init() {}
+
+/* the pulse is recorded when it is armed, a wait for its end would never finish here */
+static inline uint8_t hal_pulse_timer_is_running() {
+	return 0;
+}
+
+static inline void hal_pulse_timer_fire_at(uint16_t due) {
+	int16_t delay = due - (uint16_t)hal_host.now;
+	if (delay < 1) {
+		delay = 1;
+	} else if (delay > (int16_t)HAL_PULSE_MAX_DELAY_TICKS) {
+		delay = HAL_PULSE_MAX_DELAY_TICKS;
+	}
+	if (hal_host.driver_enabled) {
+		hal_host_pulse(hal_host.now + delay, hal_host.direction_left);
+	}
+}
+
+/******* Timer 0, 1 and 2 prescalers ******/
+static inline void hal_timers_halt() {}
+static inline void hal_timers_start() {}
+
+/******* Timer 1 - free running step timer ******/
+static inline void hal_step_timer_init() {}
+
+static inline void hal_step_timer_schedule_next(uint16_t ticks) {
+	uint16_t now = hal_host.now;
+	uint16_t next = hal_host.step_irq_enabled ? hal_host.compare + ticks : now + ticks;
+	if ((int16_t)(next - now) < (int16_t)HAL_STEP_TIMER_MIN_TICKS) {
+		next = now + HAL_STEP_TIMER_MIN_TICKS;
+	}
+	hal_host.compare = next;
+}
+
+static inline void hal_step_timer_schedule_at(uint16_t ticks) {
+	uint16_t now = hal_host.now;
+	if ((int16_t)(ticks - now) < (int16_t)HAL_STEP_TIMER_MIN_TICKS) {
+		ticks = now + HAL_STEP_TIMER_MIN_TICKS;
+	}
+	hal_host.compare = ticks;
+}
+
+static inline uint16_t hal_step_timer_compare() {
+	return hal_host.compare;
+}
+
+static inline uint16_t hal_step_timer_now() {
+	return hal_host.now;
+}
+
+static inline void hal_step_timer_overflow_irq_enable() {
+	hal_host.overflow_irq_enabled = 1u;
+}
+
+static inline uint8_t hal_step_timer_overflow_is_pending() {
+	return hal_host.overflow_pending;
+}
+
+static inline void hal_step_timer_irq_enable() {
+	hal_host.step_irq_enabled = 1u;
+}
+
+static inline void hal_step_timer_irq_disable() {
+	hal_host.step_irq_enabled = 0u;
+}
+
+static inline uint8_t hal_step_timer_irq_is_enabled() {
+	return hal_host.step_irq_enabled;
+}
+
+/******* Timer 0 - 2 ms system tick ******/
+static inline void hal_tick_timer_init() {
+	hal_host.tick_enabled = 1u;
+}
+
+/******* ISR timing probes ******/
+static inline void hal_probes_init() {}
+static inline void hal_probe_encoder_begin() {}
+static inline void hal_probe_encoder_end() {}
+static inline void hal_probe_support_begin() {}
+static inline void hal_probe_support_end() {}
+static inline void hal_probe_tick_begin() {}
+static inline void hal_probe_tick_end() {}
+
+#endif /* HAL_HOST_H_ */
@@ -0,0 +1,25 @@
+/*
+ * The parts of the firmware the tick interrupt calls but the simulator does not compile.
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "led.h"
+#include "buttons.h"
+#include "scheduler.h"
+#include "diagnostics.h"
+
+void led_toggle() {}
+
+void buttons_scan() {}
+
+void scheduler_tick() {}
+
+#if DIAGNOSTICS
+volatile uint16_t diagnostics_encoder_isr_max = 0u;
+volatile uint16_t diagnostics_step_isr_max = 0u;
+volatile uint16_t diagnostics_following_error_max = 0u;
+uint16_t diagnostics_main_loops = 0u;
+
+void diagnostics_second() {}
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Checks rational_approximate() against a brute-force search over every denominator up to the
+ * limit, for random fractions and limits, and that a fraction which fits the limit comes back
+ * reduced. Exits with 1 and prints the first cases that fail.
+ */
+
+#include <stdio.h>
+#include "rational.h"
+
+#define TEST_CASES 20000u
+#define TEST_FULL_LIMIT_CASES 200u // limit 65535, 64k denominators each
+#define TEST_MAX_REPORTS 10u
+
+static uint32_t test_random_state = 2463534242u;
+static uint32_t test_failures = 0u;
+
+static uint32_t test_random() {
+	test_random_state ^= test_random_state << 13;
+	test_random_state ^= test_random_state >> 17;
+	test_random_state ^= test_random_state << 5;
+	return test_random_state;
+}
+
+/* 1 when pa / qa is closer to numerator / denominator than pb / qb; the scaled distances stay
+ * below 2^48 and the denominators below 2^16, so the products fit 64 bits */
+static int test_is_closer(uint32_t pa, uint32_t qa, uint32_t pb, uint32_t qb, uint32_t numerator, uint32_t denominator) {
+	uint64_t left_a = (uint64_t)pa * denominator;
+	uint64_t right_a = (uint64_t)qa * numerator;
+	uint64_t left_b = (uint64_t)pb * denominator;
+	uint64_t right_b = (uint64_t)qb * numerator;
+	uint64_t distance_a = (left_a > right_a) ? left_a - right_a : right_a - left_a; // scaled by qa * denominator
+	uint64_t distance_b = (left_b > right_b) ? left_b - right_b : right_b - left_b; // scaled by qb * denominator
+	return distance_a * qb < distance_b * qa;
+}
+
+static void test_fail(const char *what, uint32_t numerator, uint32_t denominator, uint16_t limit, rational_t result) {
+	if (test_failures++ < TEST_MAX_REPORTS) {
+		printf("FAIL: %s for %u/%u limit %u, got %u/%u\n", what, numerator, denominator, limit, result.numerator, result.denominator);
+	}
+}
+
+static void test_case(uint32_t numerator, uint32_t denominator, uint16_t limit) {
+	rational_t result = rational_approximate(numerator, denominator, limit);
+
+	if ((result.denominator == 0u) || (result.numerator > limit) || (result.denominator > limit)) {
+		test_fail("out of range", numerator, denominator, limit, result);
+		return;
+	}
+	for (uint32_t q = 1u; q <= limit; q++) {
+		uint64_t p = (uint64_t)q * numerator / denominator; // the closest p are p and p + 1
+		for (uint64_t candidate = p; (candidate <= p + 1u) && (candidate <= limit); candidate++) {
+			if (test_is_closer(candidate, q, result.numerator, result.denominator, numerator, denominator)) {
+				test_fail("not the closest", numerator, denominator, limit, result);
+				printf("  %u/%u is closer\n", (uint32_t)candidate, q);
+				return;
+			}
+		}
+	}
+	if ((numerator <= limit) && (denominator <= limit)) {
+		uint32_t divisor = rational_gcd(numerator, denominator);
+		if ((result.numerator != numerator / divisor) || (result.denominator != denominator / divisor)) {
+			test_fail("not the reduced fraction", numerator, denominator, limit, result);
+		}
+	}
+}
+
+static uint32_t test_random_term() {
+	switch (test_random() % 3u) {
+	case 0: return test_random() % 1000u + 1u;
+	case 1: return test_random() % 100000u + 1u;
+	default: return test_random() | 1u;
+	}
+}
+
+int main() {
+	for (uint32_t i = 0u; i < TEST_CASES; i++) {
+		test_case(test_random_term(), test_random_term(), test_random() % 2000u + 1u);
+	}
+	for (uint32_t i = 0u; i < TEST_FULL_LIMIT_CASES; i++) {
+		test_case(test_random_term(), test_random_term(), UINT16_MAX);
+	}
+	test_case(200u * 1500u, 3000u * 2400u, UINT16_MAX); // 1.5 mm pitch, fits exactly
+	test_case(314159265u, 100000000u, UINT16_MAX); // pi
+
+	if (test_failures) {
+		printf("%u of %u cases failed\n", test_failures, TEST_CASES + TEST_FULL_LIMIT_CASES + 2u);
+		return 1;
+	}
+	printf("rational_approximate: %u cases passed\n", TEST_CASES + TEST_FULL_LIMIT_CASES + 2u);
+	return 0;
+}
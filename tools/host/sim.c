@@ -0,0 +1,385 @@
+/*
+ * Simulator of the spindle encoder and the support stepper on a PC. spindle.c, support.c and
+ * revolutions.c are compiled unmodified against hal_host.h; the simulator turns a virtual
+ * spindle, calls their interrupt handlers in the order of the vector priorities and checks the
+ * driver pulses they produce.
+ *
+ *   sim [-r rpm] [-a seconds] [-t seconds] [-n numerator] [-d denominator] [-p]
+ *       [-m max error] [-l encoder,step,tick] [-e edges.csv] [-w edges.csv] [-s pulses.csv]
+ *       [-g pulses.csv]
+ *
+ * The spindle accelerates to rpm in -a seconds, turns for -t seconds and stops in -a seconds,
+ * or replays the encoder steps of a recorded cut (-e, tools/telemetry_decode.py --edges); then
+ * the support gets SIM_SETTLE_SECONDS to reach the required position. -p turns on the velocity
+ * feed-forward like the prediction item of the setup menu. -w writes the spindle steps in the
+ * format of -e, -s writes every driver pulse and -g compares them with a golden run written by -s.
+ * -l gives the CPU cycles the encoder, step and tick handlers keep the interrupts disabled, prologue
+ * and epilogue included (tools/bench measures them); without it the handlers take no time.
+ * Exits with 1 when the support does not end at the required position, two pulses overlap, a
+ * pulse differs from the golden run, an encoder step was lost or, with -m, the following error exceeds max error steps or
+ * raises the alarm.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "main.h"
+#include "hal.h"
+#include "spindle.h"
+#include "support.h"
+#include "revolutions.h"
+
+#define SIM_TICK_TICKS (HAL_STEP_TIMER_HZ / 500u) // Timer0, 2 ms
+#define SIM_LEAD_TICKS 5u // task_lead in main.c, 10 ms
+#define SIM_SETTLE_SECONDS 4.0 // the speed measurement decays in RPM_TIMEOUT_TICKS
+#define SIM_LINE_LENGTH 128u
+#define SIM_CYCLES_PER_TICK 8u // 16 MHz CPU, HAL_STEP_TIMER_HZ
+
+void hal_host_INT0_vect();
+void hal_host_PCINT0_vect();
+void hal_host_TIMER1_COMPA_vect();
+void hal_host_TIMER1_OVF_vect();
+void hal_host_TIMER0_COMPA_vect();
+
+/******* driver pulses ******/
+static FILE *sim_pulses_file = NULL;
+static int32_t sim_driver_position = 0;
+static uint32_t sim_pulses = 0u;
+static uint32_t sim_last_pulse = 0u;
+static uint32_t sim_min_pulse_spacing = UINT32_MAX;
+static uint32_t sim_pulse_overlaps = 0u;
+static uint8_t sim_recording = 0u;
+static FILE *sim_golden_file = NULL;
+static uint32_t sim_golden_mismatches = 0u;
+
+/* reads the next "time_s,x,...,flag" line of a CSV file, the middle columns are skipped */
+static uint8_t sim_read_csv(FILE *file, double *time, unsigned *flag) {
+	char line[SIM_LINE_LENGTH];
+	while (fgets(line, sizeof(line), file)) {
+		char *last = strrchr(line, ',');
+		if (last && (sscanf(line, "%lf", time) == 1) && (sscanf(last + 1, "%u", flag) == 1)) {
+			return 1;
+		}
+	}
+	return 0; // the end, header lines are skipped
+}
+
+static void sim_golden_compare(uint32_t time, uint8_t direction_left) {
+	double golden_time;
+	unsigned golden_left;
+
+	if (!sim_read_csv(sim_golden_file, &golden_time, &golden_left)) {
+		if (!sim_golden_mismatches++) {
+			printf("FAIL: pulse %u at %.7f s is not in the golden run\n", sim_pulses, (double)time / HAL_STEP_TIMER_HZ);
+		}
+	} else if ((llround(golden_time * HAL_STEP_TIMER_HZ) != time) || (golden_left != direction_left)) {
+		if (!sim_golden_mismatches++) {
+			printf("FAIL: pulse %u at %.7f s left %u, the golden run has %.7f s left %u\n",
+				sim_pulses, (double)time / HAL_STEP_TIMER_HZ, direction_left, golden_time, golden_left);
+		}
+	}
+}
+
+void hal_host_pulse(uint32_t time, uint8_t direction_left) {
+	if (!sim_recording) {
+		return; // support_init() fires one pulse to set up Timer2
+	}
+	if (sim_pulses > 0u) {
+		uint32_t spacing = time - sim_last_pulse;
+		if ((int32_t)spacing < (int32_t)HAL_PULSE_WIDTH_TICKS) {
+			sim_pulse_overlaps++;
+		}
+		if (spacing < sim_min_pulse_spacing) {
+			sim_min_pulse_spacing = spacing;
+		}
+	}
+	if (sim_golden_file) {
+		sim_golden_compare(time, direction_left);
+	}
+	sim_last_pulse = time;
+	sim_pulses++;
+	sim_driver_position += direction_left ? 1 : -1;
+	if (sim_pulses_file) {
+		fprintf(sim_pulses_file, "%.7f,%u\n", (double)time / HAL_STEP_TIMER_HZ, direction_left);
+	}
+}
+
+/******* interrupt flags ******/
+/* in the order of the vector priorities; TOV1 is hal_host.overflow_pending, the firmware reads it */
+enum { SIM_INT0, SIM_PCINT0, SIM_TIMER1_COMPA, SIM_TIMER0_COMPA, SIM_VECTORS };
+static uint8_t sim_pending[SIM_VECTORS];
+
+/******* spindle encoder ******/
+/* yellow << 1 | green, counting up: 00 -> 01 -> 11 -> 10 */
+static const uint8_t sim_encoder_sequence[4] = { 0u, 1u, 3u, 2u };
+static uint8_t sim_encoder_phase = 0u;
+static uint32_t sim_spindle_steps = 0u;
+static FILE *sim_edges_file = NULL;
+
+static void sim_encoder_step(int8_t direction) {
+	if (sim_edges_file) {
+		fprintf(sim_edges_file, "%.7f,%u,%u\n", (double)hal_host.now / HAL_STEP_TIMER_HZ,
+			(unsigned)(hal_host.now / SIM_TICK_TICKS) & 0xFFu, (direction > 0) ? 1u : 0u);
+	}
+	uint8_t previous = hal_host.encoder;
+	sim_encoder_phase = (sim_encoder_phase + direction) & 3u;
+	hal_host.encoder = sim_encoder_sequence[sim_encoder_phase];
+	sim_spindle_steps += direction;
+	if (!hal_host.encoder_enabled) {
+		return;
+	}
+	if ((previous ^ hal_host.encoder) & 0x02u) {
+		sim_pending[SIM_INT0] = 1u;
+	} else {
+		sim_pending[SIM_PCINT0] = 1u;
+	}
+}
+
+/******* virtual time ******/
+static uint8_t sim_prediction = 0u;
+static uint32_t sim_ticks = 0u;
+
+/* task_lead of the main loop, which runs after the tick */
+static void sim_main_loop() {
+	if (sim_prediction && (++sim_ticks % SIM_LEAD_TICKS == 0u)) {
+		support_update_lead(get_spindle_steps_per_second());
+	}
+}
+
+/* -l, Timer1 ticks a handler keeps the interrupts disabled, 0 = the handlers take no time */
+static uint32_t sim_encoder_ticks = 0u;
+static uint32_t sim_step_ticks = 0u;
+static uint32_t sim_tick_ticks = 0u;
+static uint32_t sim_busy_until = 0u;
+
+/* runs the pending handler of the highest priority, 0 = none is pending */
+static uint8_t sim_dispatch() {
+	if (sim_pending[SIM_INT0] || sim_pending[SIM_PCINT0]) {
+		uint8_t int0 = sim_pending[SIM_INT0];
+		sim_pending[int0 ? SIM_INT0 : SIM_PCINT0] = 0u;
+		if (int0) {
+			hal_host_INT0_vect();
+		} else {
+			hal_host_PCINT0_vect();
+		}
+		sim_busy_until = hal_host.now + sim_encoder_ticks;
+	} else if (sim_pending[SIM_TIMER1_COMPA]) {
+		sim_pending[SIM_TIMER1_COMPA] = 0u;
+		if (hal_host.step_irq_enabled) {
+			hal_host_TIMER1_COMPA_vect();
+			sim_busy_until = hal_host.now + sim_step_ticks;
+		}
+	} else if (hal_host.overflow_pending && hal_host.overflow_irq_enabled) {
+		hal_host.overflow_pending = 0u;
+		hal_host_TIMER1_OVF_vect();
+	} else if (sim_pending[SIM_TIMER0_COMPA]) {
+		sim_pending[SIM_TIMER0_COMPA] = 0u;
+		hal_host_TIMER0_COMPA_vect();
+		sim_busy_until = hal_host.now + sim_tick_ticks;
+		sim_main_loop();
+	} else {
+		return 0u;
+	}
+	return 1u;
+}
+
+/* one Timer1 tick with a spindle step in 'direction' or none; the flags raised in it latch, and
+ * once the running handler ends the pending ones run in the order of their vectors. A handler
+ * reads the encoder when it runs, so an edge on the other wire before that is an encoder error. */
+static void sim_clock(int8_t direction) {
+	hal_host.now++;
+	if ((uint16_t)hal_host.now == 0u) {
+		hal_host.overflow_pending = 1u;
+	}
+	if (direction) {
+		sim_encoder_step(direction);
+	}
+	if (hal_host.step_irq_enabled && ((uint16_t)hal_host.now == hal_host.compare)) {
+		sim_pending[SIM_TIMER1_COMPA] = 1u;
+	}
+	if (hal_host.tick_enabled && (hal_host.now % SIM_TICK_TICKS == 0u)) {
+		sim_pending[SIM_TIMER0_COMPA] = 1u;
+	}
+	while (((int32_t)(hal_host.now - sim_busy_until) >= 0) && sim_dispatch()) {
+	}
+}
+
+/* turns the spindle with a trapezoidal speed profile */
+static void sim_run(double rpm, double accelerate, double cut) {
+	double top = rpm * SPINDLE_STEPS_FOR_ONE_TURN / 60.0 / HAL_STEP_TIMER_HZ; // spindle steps per tick
+	uint32_t ramp = accelerate * HAL_STEP_TIMER_HZ;
+	uint32_t end = (2.0 * accelerate + cut) * HAL_STEP_TIMER_HZ;
+	double phase = 0.0;
+
+	for (uint32_t t = 0u; t < end; t++) {
+		double speed = top;
+		if (t >= end) {
+			speed = 0.0;
+		} else if ((ramp > 0u) && (t < ramp)) {
+			speed = top * t / ramp;
+		} else if ((ramp > 0u) && (t > end - ramp)) {
+			speed = top * (end - t) / ramp;
+		}
+		phase += speed;
+		if (phase >= 1.0) {
+			phase -= 1.0;
+			sim_clock(1);
+		} else {
+			sim_clock(0);
+		}
+	}
+}
+
+/* replays the steps of a recorded cut from its first step on; steps recorded in the same tick
+ * follow one tick apart */
+static void sim_replay(FILE *edges) {
+	double first = 0.0;
+	double time;
+	unsigned rotate_left;
+	uint8_t started = 0u;
+
+	while (sim_read_csv(edges, &time, &rotate_left)) {
+		if (!started) {
+			started = 1u;
+			first = time;
+		}
+		uint32_t due = llround((time - first) * HAL_STEP_TIMER_HZ) + 1u;
+		while ((int32_t)(due - hal_host.now) > 1) {
+			sim_clock(0);
+		}
+		sim_clock(rotate_left ? 1 : -1);
+	}
+}
+
+static void sim_settle() {
+	for (uint32_t t = 0u; t < SIM_SETTLE_SECONDS * HAL_STEP_TIMER_HZ; t++) {
+		sim_clock(0);
+	}
+}
+
+static FILE *sim_open(const char *name, const char *mode) {
+	FILE *file = fopen(name, mode);
+	if (!file) {
+		perror(name);
+		exit(2);
+	}
+	return file;
+}
+
+int main(int argc, char *argv[]) {
+	double rpm = 300.0;
+	double accelerate = 1.0;
+	double cut = 5.0;
+	uint16_t numerator = 1u;
+	uint16_t denominator = 12u; // 3 mm pitch
+	FILE *replay = NULL;
+	long max_error = -1; // no bound
+	unsigned encoder_cycles, step_cycles, tick_cycles;
+	int option;
+
+	while ((option = getopt(argc, argv, "r:a:t:n:d:pm:l:e:w:s:g:")) != -1) {
+		switch (option) {
+		case 'r': rpm = atof(optarg); break;
+		case 'a': accelerate = atof(optarg); break;
+		case 't': cut = atof(optarg); break;
+		case 'n': numerator = atoi(optarg); break;
+		case 'd': denominator = atoi(optarg); break;
+		case 'p': sim_prediction = 1u; break;
+		case 'm': max_error = atol(optarg); break;
+		case 'l':
+			if (sscanf(optarg, "%u,%u,%u", &encoder_cycles, &step_cycles, &tick_cycles) != 3) {
+				fprintf(stderr, "-l needs the encoder,step,tick cycles\n");
+				return 2;
+			}
+			sim_encoder_ticks = (encoder_cycles + SIM_CYCLES_PER_TICK - 1u) / SIM_CYCLES_PER_TICK;
+			sim_step_ticks = (step_cycles + SIM_CYCLES_PER_TICK - 1u) / SIM_CYCLES_PER_TICK;
+			sim_tick_ticks = (tick_cycles + SIM_CYCLES_PER_TICK - 1u) / SIM_CYCLES_PER_TICK;
+			break;
+		case 'e': replay = sim_open(optarg, "r"); break;
+		case 'w':
+			sim_edges_file = sim_open(optarg, "w");
+			fprintf(sim_edges_file, "time_s,sequence,rotate_left\n");
+			break;
+		case 's':
+			sim_pulses_file = sim_open(optarg, "w");
+			fprintf(sim_pulses_file, "time_s,rotate_left\n");
+			break;
+		case 'g': sim_golden_file = sim_open(optarg, "r"); break;
+		default:
+			fprintf(stderr, "usage: %s [-r rpm] [-a seconds] [-t seconds] [-n numerator] [-d denominator] [-p]"
+				" [-m max error] [-l encoder,step,tick] [-e edges.csv] [-w edges.csv] [-s pulses.csv] [-g pulses.csv]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (denominator == 0u) {
+		fprintf(stderr, "the denominator must not be 0\n");
+		return 2;
+	}
+
+	init_revolution_calculation();
+	support_init();
+	support_set_fraction(numerator, denominator, sim_prediction);
+	init_step_counting(1u);
+	sim_recording = 1u;
+
+	if (replay) {
+		sim_replay(replay);
+		fclose(replay);
+		printf("replay %u/%u%s\n", numerator, denominator, sim_prediction ? " with prediction" : "");
+	} else {
+		sim_run(rpm, accelerate, cut);
+		printf("%.0f RPM %u/%u%s\n", rpm, numerator, denominator, sim_prediction ? " with prediction" : "");
+	}
+	sim_settle();
+
+	uint32_t required = get_required_support_position();
+	uint32_t actual = get_actual_support_position();
+	printf("  spindle steps      %u\n", sim_spindle_steps);
+	printf("  support required   %u actual %u driver %d\n", required, actual, sim_driver_position);
+	printf("  following error    max %u rms %u\n", get_following_error_max(), get_following_error_rms());
+	printf("  max spindle speed  %u RPM\n", get_max_revolutions_per_minute());
+	if (sim_pulses > 1u) {
+		printf("  min pulse spacing  %u ticks, %lu steps/s\n", sim_min_pulse_spacing, HAL_STEP_TIMER_HZ / sim_min_pulse_spacing);
+	}
+	printf("  queue overruns     %u\n", get_step_queue_overruns());
+	printf("  encoder errors     %u\n", get_encoder_errors());
+	if (sim_pulses_file) {
+		fclose(sim_pulses_file);
+	}
+	if (sim_edges_file) {
+		fclose(sim_edges_file);
+	}
+	if (sim_golden_file) {
+		double time;
+		unsigned left;
+		if (!sim_golden_mismatches && sim_read_csv(sim_golden_file, &time, &left)) {
+			printf("FAIL: the golden run has more pulses than %u\n", sim_pulses);
+			sim_golden_mismatches++;
+		}
+		fclose(sim_golden_file);
+	}
+
+	if ((actual != required) || ((uint32_t)sim_driver_position != actual)) {
+		printf("FAIL: the support did not reach the required position\n");
+		return 1;
+	}
+	if (get_encoder_errors()) {
+		printf("FAIL: %u encoder steps were lost\n", get_encoder_errors());
+		return 1;
+	}
+	if (sim_pulse_overlaps) {
+		printf("FAIL: %u pulses overlapped\n", sim_pulse_overlaps);
+		return 1;
+	}
+	if ((max_error >= 0) && (get_following_error_max() > max_error)) {
+		printf("FAIL: the following error exceeded %ld steps\n", max_error);
+		return 1;
+	}
+	if ((max_error >= 0) && support_alarm_is_active()) {
+		printf("FAIL: the following error raised the alarm\n");
+		return 1;
+	}
+	return sim_golden_mismatches ? 1 : 0;
+}
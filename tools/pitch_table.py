@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Generates sources/GccApplication1/pitch_table.c, the thread pitches selectable in the setup menu.
+
+Each pitch is stored as the ratio of support motor steps to spindle encoder steps (4x quadrature),
+reduced to the smallest integers, so the gearing in support.c follows it without rounding error.
+Module pitches contain pi and get the closest ratio that fits into 16 bits; the error is noted.
+
+Run after changing the machine constants below, they must match main.h:
+    python3 tools/pitch_table.py
+"""
+
+import math
+import os
+from fractions import Fraction
+
+LEADSCREW_PITCH_UM = 3000
+SUPPORT_STEPS_PER_LEADSCREW_TURN = 200
+STEPS_FOR_ONE_TURN = 600  # encoder lines
+SPINDLE_STEPS_FOR_ONE_TURN = 4 * STEPS_FOR_ONE_TURN
+
+LIMIT = 0xFFFF  # support_set_fraction() takes uint16_t
+
+METRIC_MM = ["0.2", "0.25", "0.3", "0.35", "0.4", "0.45", "0.5", "0.6", "0.7", "0.75", "0.8", "1",
+             "1.25", "1.5", "1.75", "2", "2.5", "3", "3.5", "4", "4.5", "5", "5.5", "6"]
+TPI = ["4", "4.5", "5", "6", "7", "8", "9", "10", "11", "11.5", "12", "13", "14", "16", "18", "19",
+       "20", "22", "24", "26", "27", "28", "32", "36", "40", "44", "48", "56", "64", "72", "80"]
+MODULE = ["0.2", "0.25", "0.3", "0.4", "0.5", "0.6", "0.7", "0.75", "0.8", "1", "1.25", "1.5",
+          "1.75", "2", "2.25", "2.5", "2.75", "3", "3.5", "4"]
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "sources", "GccApplication1", "pitch_table.c")
+
+
+def ratio(pitch_um):
+    """support steps per spindle step for a pitch in micrometres"""
+    return pitch_um * SUPPORT_STEPS_PER_LEADSCREW_TURN / (LEADSCREW_PITCH_UM * SPINDLE_STEPS_FOR_ONE_TURN)
+
+
+def closest(value, limit):
+    """best rational approximation with numerator and denominator <= limit (continued fractions)"""
+    best = Fraction(value).limit_denominator(limit)
+    while best.numerator > limit:
+        limit = limit * best.denominator // best.numerator
+        best = Fraction(value).limit_denominator(limit)
+    return best
+
+
+def entries():
+    for mm in METRIC_MM:
+        yield "%.2fmm" % float(mm), ratio(Fraction(mm) * 1000), None
+    for tpi in TPI:
+        yield "%sTPI" % tpi if len(tpi) > 2 else "%s TPI" % tpi, ratio(Fraction(25400) / Fraction(tpi)), None
+    for module in MODULE:
+        exact = float(ratio(Fraction(module) * 1000)) * math.pi
+        yield "m%.2f" % float(module), closest(exact, LIMIT), exact
+
+
+def main():
+    lines = [
+        "/* Generated by tools/pitch_table.py, do not edit. */",
+        "",
+        '#include "pitch_table.h"',
+        '#include "main.h"',
+        "",
+        "#if (LEADSCREW_PITCH_UM != %du) || (SUPPORT_STEPS_PER_LEADSCREW_TURN != %du) || (SPINDLE_STEPS_FOR_ONE_TURN != %du)"
+        % (LEADSCREW_PITCH_UM, SUPPORT_STEPS_PER_LEADSCREW_TURN, SPINDLE_STEPS_FOR_ONE_TURN),
+        '#error "pitch_table.c does not match main.h, run tools/pitch_table.py"',
+        "#endif",
+        "",
+        "const pitch_t pitch_table[] PROGMEM = {",
+    ]
+    for name, fraction, exact in entries():
+        fraction = Fraction(fraction)
+        if fraction.numerator > LIMIT or fraction.denominator > LIMIT:
+            raise SystemExit("%s: %s does not fit into 16 bits" % (name, fraction))
+        comment = ""
+        if exact is not None:
+            comment = " // error %.1e" % (abs(float(fraction) - exact) / exact)
+        lines.append('\t{ "%-7s", %5du, %5du },%s' % (name, fraction.numerator, fraction.denominator, comment))
+    lines += [
+        "};",
+        "",
+        "const uint8_t pitch_table_length = sizeof(pitch_table) / sizeof(pitch_table[0]);",
+        "",
+    ]
+    with open(OUTPUT, "w", newline="\n") as output:
+        output.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
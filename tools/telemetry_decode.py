@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Decodes the binary telemetry stream of sources/GccApplication1/telemetry.c into CSV.
+
+Reads either a serial port (needs pyserial) or a raw capture file and writes one CSV line per frame:
+    python3 tools/telemetry_decode.py /dev/ttyUSB0 > run.csv
+    python3 tools/telemetry_decode.py capture.bin -o run.csv --edges edges.csv
+Stop a serial capture with Ctrl+C. Frames with a bad CRC are skipped and the decoder resynchronises
+on the next 0xA5; frames dropped by the controller show up as gaps in the sequence column.
+
+--edges writes every recorded encoder step (TELEMETRY_EDGES in main.h) with its time on the same
+time base as the frames, the input for replaying a cut with tools/host/sim -e. The edges of a frame
+dropped for lack of buffer space and the steps counted as lost are missing from it; both are
+reported on standard error.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+BAUD = 1000000
+SYNC = 0xA5
+FRAME = struct.Struct("<BIIIIhBB")  # sequence, timestamp, spindle, required, actual, rpm, edges, lost
+EDGE = struct.Struct("<H")
+
+STEP_TIMER_HZ = 2000000  # HAL_STEP_TIMER_HZ
+SPINDLE_STEPS_FOR_ONE_TURN = 2400  # main.h
+
+COLUMNS = ["time_s", "sequence", "spindle_steps", "revolutions", "angle",
+           "required", "actual", "following_error", "rpm"]
+EDGE_COLUMNS = ["time_s", "sequence", "rotate_left"]
+
+
+def crc8_ccitt(data):
+    """_crc8_ccitt_update() of avr-libc, polynomial 0x07, initial value 0"""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def frames(read):
+    """yields (fields, edges) from a read(size) function returning bytes"""
+    buffer = bytearray()
+    end = False
+    while buffer or not end:
+        if not end:
+            chunk = read(4096)
+            end = not chunk
+            buffer += chunk
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                buffer.clear()
+                break
+            del buffer[:start]
+            length = 1 + FRAME.size
+            if len(buffer) >= length:
+                fields = FRAME.unpack_from(buffer, 1)
+                length += fields[6] * EDGE.size + 1  # edges, CRC
+            if len(buffer) < length:
+                if end:
+                    del buffer[:1]  # truncated or false sync at the end of the capture
+                    continue
+                break
+            if crc8_ccitt(buffer[1:length - 1]) != buffer[length - 1]:
+                del buffer[:1]  # false sync, search again
+                continue
+            edges = [value for (value,) in EDGE.iter_unpack(bytes(buffer[1 + FRAME.size:length - 1]))]
+            del buffer[:length]
+            yield fields, edges
+
+
+def rows(read):
+    """converts frames into (CSV row, edge rows), unwrapping the 32-bit timestamp"""
+    first = None
+    wraps = 0
+    previous = None
+    for fields, edges in frames(read):
+        sequence, timestamp, spindle, required, actual, rpm, _, lost = fields
+        if previous is not None and timestamp < previous:
+            wraps += 1
+        previous = timestamp
+        ticks = timestamp + (wraps << 32)
+        if first is None:
+            first = ticks
+        if lost:
+            sys.stderr.write("frame %d: %d encoder steps lost\n" % (sequence, lost))
+        # an edge keeps bits 15..1 of its timestamp and happened less than 32 ms before the frame
+        edge_rows = [[
+            "%.7f" % ((ticks - ((timestamp - (edge & 0xFFFE)) & 0xFFFF) - first) / STEP_TIMER_HZ),
+            sequence,
+            edge & 1,
+        ] for edge in edges]
+        yield [
+            "%.6f" % ((ticks - first) / STEP_TIMER_HZ),
+            sequence,
+            spindle,
+            spindle // SPINDLE_STEPS_FOR_ONE_TURN,
+            spindle % SPINDLE_STEPS_FOR_ONE_TURN,
+            required,
+            actual,
+            signed32((required - actual) & 0xFFFFFFFF),
+            rpm,
+        ], edge_rows
+
+
+def write_row(output, row):
+    output.write(",".join(str(value) for value in row) + "\n")
+
+
+def open_source(name):
+    if os.path.isfile(name):
+        return open(name, "rb")
+    import serial  # pyserial, only needed for a live capture
+    return serial.Serial(name, BAUD)  # blocking, read() waits for the whole chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial port or raw capture file")
+    parser.add_argument("-o", "--output", help="CSV file, standard output by default")
+    parser.add_argument("--edges", help="CSV file for the recorded encoder steps")
+    arguments = parser.parse_args()
+
+    output = open(arguments.output, "w") if arguments.output else sys.stdout
+    edge_output = open(arguments.edges, "w") if arguments.edges else None
+    with open_source(arguments.source) as source:
+        write_row(output, COLUMNS)
+        if edge_output:
+            write_row(edge_output, EDGE_COLUMNS)
+        previous = None
+        try:
+            for row, edge_rows in rows(source.read):
+                sequence = row[1]
+                if previous is not None and sequence != (previous + 1) & 0xFF:
+                    sys.stderr.write("frames %d..%d dropped\n" % ((previous + 1) & 0xFF, (sequence - 1) & 0xFF))
+                previous = sequence
+                write_row(output, row)
+                if edge_output:
+                    for edge_row in edge_rows:
+                        write_row(edge_output, edge_row)
+        except KeyboardInterrupt:
+            pass
+    if output is not sys.stdout:
+        output.close()
+    if edge_output:
+        edge_output.close()
+
+
+if __name__ == "__main__":
+    main()